@@ -0,0 +1,217 @@
+#include "BVH4.h"
+
+#include <algorithm>
+#include <cassert>
+#include <limits>
+
+using namespace Eigen;
+
+static float HalfArea(const BVHNode& n)
+{
+	float dx = n.maxX - n.minX;
+	float dy = n.maxY - n.minY;
+	float dz = n.maxZ - n.minZ;
+	return dx * dy + dy * dz + dz * dx;
+}
+
+BVH4::BVH4() : depth(0) {}
+BVH4::~BVH4() {}
+
+void BVH4::Build(const MatrixXd& V, double epsilon)
+{
+	BVHTree tree;
+	tree.Build(V, MatrixXi(), epsilon, BVHTree::BuildMethod::BinnedSAH);
+	Build(tree);
+}
+
+void BVH4::Build(const BVHTree& tree)
+{
+	const auto& binary = tree.GetNodes();
+
+	assert(!binary.empty());
+	assert(nodes.empty());
+
+	// slots freed by BVHTree::RemoveLeaf are leaves with a negative index
+	int numLeaves = 0;
+	for (const auto& n : binary)
+		if (n.IsLeaf()) numLeaves = std::max(numLeaves, n.GetIndex() + 1);
+	leaves.resize(numLeaves);
+	for (const auto& n : binary)
+		if (n.IsLeaf() && n.GetIndex() >= 0) leaves[n.GetIndex()] = n;
+
+	nodes.reserve(binary.size() / 3 + 1);
+	depth = 0;
+	Collapse(binary, 0, 1);
+}
+
+// Turns the binary subtree at root into one 4-wide node by repeatedly opening the
+// inner child with the largest surface area, then recurses into the inner children.
+int BVH4::Collapse(const std::vector<BVHNode>& binary, int root, int level)
+{
+	depth = std::max(depth, level);
+
+	int children[4];
+	int count = 0;
+	if (binary[root].IsLeaf())
+	{
+		children[count++] = root;
+	}
+	else
+	{
+		children[count++] = binary[root].left;
+		children[count++] = binary[root].right;
+	}
+
+	while (count < 4)
+	{
+		int best = -1;
+		for (int k = 0; k < count; k++)
+		{
+			const BVHNode& c = binary[children[k]];
+			if (!c.IsLeaf() && (best < 0 || HalfArea(c) > HalfArea(binary[children[best]]))) best = k;
+		}
+		if (best < 0) break;
+
+		int opened = children[best];
+		children[best] = binary[opened].left;
+		children[count++] = binary[opened].right;
+	}
+
+	int index = static_cast<int>(nodes.size());
+	nodes.emplace_back();
+
+	BVH4Node node;
+	const float inf = std::numeric_limits<float>::infinity();
+	for (int k = 0; k < 4; k++)
+	{
+		node.minX[k] = node.minY[k] = node.minZ[k] = inf;
+		node.maxX[k] = node.maxY[k] = node.maxZ[k] = -inf;
+		node.child[k] = ~0;
+	}
+
+	for (int k = 0; k < count; k++)
+	{
+		const BVHNode& c = binary[children[k]];
+		node.minX[k] = c.minX;
+		node.minY[k] = c.minY;
+		node.minZ[k] = c.minZ;
+		node.maxX[k] = c.maxX;
+		node.maxY[k] = c.maxY;
+		node.maxZ[k] = c.maxZ;
+		node.child[k] = c.IsLeaf() ? ~c.GetIndex() : Collapse(binary, children[k], level + 1);
+	}
+
+	// the recursion above may have reallocated nodes
+	nodes[index] = node;
+	return index;
+}
+
+BVHNode BVH4::GetChildBounds(const BVH4Node& node, int k)
+{
+	BVHNode n;
+	n.minX = node.minX[k];
+	n.minY = node.minY[k];
+	n.minZ = node.minZ[k];
+	n.maxX = node.maxX[k];
+	n.maxY = node.maxY[k];
+	n.maxZ = node.maxZ[k];
+	n.left = -1;
+	n.right = -1;
+	return n;
+}
+
+void BVH4::BroadPhaseDetect(CandidateIndexPairs& candiatePairs, int numThreads)
+{
+	WorkStealingPool pool(numThreads);
+	std::vector<std::vector<std::pair<int, int>>> buffers(pool.GetNumThreads());
+	Detect(pool, [&](int i, int j, int thread) { buffers[thread].emplace_back(i, j); });
+	MergeCandidatePairs(buffers, candiatePairs);
+}
+
+void BVH4::BroadPhaseDetect(const CandidatePairVisitor& visitor, int numThreads)
+{
+	WorkStealingPool pool(numThreads);
+	Detect(pool, [&](int i, int j, int) { visitor(i, j); });
+}
+
+void BVH4::Detect(WorkStealingPool& pool, const PairEmitter& emit) const
+{
+	if (nodes.empty()) return;
+
+	int spawnDepth = 2;
+	for (int t = 1; t < pool.GetNumThreads(); t <<= 2) spawnDepth++;
+
+	pool.Run([&](int thread) { Traverse({ 0, 0, 0 }, spawnDepth, pool, thread, emit); });
+}
+
+// Same self-overlap traversal as BVHTree, but a step tests one child of a node
+// against all four children of the other node with a single OverlapMask.
+void BVH4::Traverse(ChildPair root, int spawnDepth, WorkStealingPool& pool, int thread, const PairEmitter& emit) const
+{
+	std::vector<ChildPair> stack;
+	auto push = [&](int32_t a, int32_t b, int depth) {
+		if (BVH4Node::IsLeaf(a) && BVH4Node::IsLeaf(b))
+		{
+			int idx1 = BVH4Node::GetIndex(a);
+			int idx2 = BVH4Node::GetIndex(b);
+			emit(std::min(idx1, idx2), std::max(idx1, idx2), thread);
+		}
+		else if (depth < spawnDepth)
+		{
+			ChildPair p = { a, b, depth };
+			pool.Spawn(thread, [=, &pool, &emit](int t) { Traverse(p, spawnDepth, pool, t, emit); });
+		}
+		else
+		{
+			stack.push_back({ a, b, depth });
+		}
+	};
+
+	stack.push_back(root);
+	while (!stack.empty())
+	{
+		ChildPair p = stack.back();
+		stack.pop_back();
+
+		if (p.a == p.b)
+		{
+			const BVH4Node& node = nodes[p.a];
+			for (int i = 0; i < 4; i++)
+			{
+				int32_t ci = node.child[i];
+				if (!(node.minX[i] <= node.maxX[i])) continue;  // unused lane
+				if (!BVH4Node::IsLeaf(ci)) push(ci, ci, p.depth + 1);
+
+				int mask = OverlapMask(node, GetChildBounds(node, i)) & (0xE << i);
+				for (int j = i + 1; j < 4; j++)
+					if (mask & (1 << j)) push(ci, node.child[j], p.depth + 1);
+			}
+		}
+		else
+		{
+			// keep the inner node in b, open it against a, or against every child
+			// of a if both are inner nodes
+			int32_t a = p.a, b = p.b;
+			if (BVH4Node::IsLeaf(b)) std::swap(a, b);
+			const BVH4Node& nb = nodes[b];
+
+			if (BVH4Node::IsLeaf(a))
+			{
+				int mask = OverlapMask(nb, leaves[BVH4Node::GetIndex(a)]);
+				for (int j = 0; j < 4; j++)
+					if (mask & (1 << j)) push(a, nb.child[j], p.depth + 1);
+			}
+			else
+			{
+				const BVH4Node& na = nodes[a];
+				for (int i = 0; i < 4; i++)
+				{
+					if (!(na.minX[i] <= na.maxX[i])) continue;
+					int mask = OverlapMask(nb, GetChildBounds(na, i));
+					for (int j = 0; j < 4; j++)
+						if (mask & (1 << j)) push(na.child[i], nb.child[j], p.depth + 1);
+				}
+			}
+		}
+	}
+}
@@ -0,0 +1,142 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <Eigen/Core>
+
+#include "BroadPhase.h"
+#include "BVHTree.h"
+#include "WorkStealingPool.h"
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define BVH4_USE_SSE
+#include <xmmintrin.h>
+#endif
+
+// Node of the 4-wide tree: the bounds of the four children in SoA layout, so one
+// SSE instruction tests a query against all of them. Unused lanes have empty
+// (inverted) bounds and never pass a test.
+struct alignas(16) BVH4Node
+{
+	float minX[4];
+	float minY[4];
+	float minZ[4];
+	float maxX[4];
+	float maxY[4];
+	float maxZ[4];
+	int32_t child[4];  // >= 0: index of an inner node, < 0: ~index of a leaf primitive
+
+	static bool IsLeaf(int32_t child) { return child < 0; }
+	static int GetIndex(int32_t child) { return ~child; }
+};
+
+static_assert(sizeof(BVH4Node) == 112, "BVH4Node must stay packed");
+
+
+// 4-ary BVH collapsed from a binary BVHTree. Halves the depth of the binary tree and
+// replaces its per-node branches with one vectorized test per four children. The
+// node format is query agnostic: Traverse takes any 4-lane box test, so overlap,
+// ray or nearest-point queries can share the same tree.
+class BVH4
+{
+	std::vector<BVH4Node> nodes;  // root is nodes[0]
+	std::vector<BVHNode> leaves;  // leaf bounds by primitive index
+	int depth;                    // number of inner nodes on the longest path
+public:
+	BVH4();
+	~BVH4();
+
+	void Build(const BVHTree& tree);
+	void Build(const Eigen::MatrixXd& V, double epsilon);
+
+	// all pairs of overlapping leaves, same contract as BVHTree::BroadPhaseDetect
+	void BroadPhaseDetect(CandidateIndexPairs& candiatePairs, int numThreads = 0);
+	void BroadPhaseDetect(const CandidatePairVisitor& visitor, int numThreads = 0);
+
+	// visit(index) for every leaf whose bounds overlap box
+	template <typename LeafVisit>
+	void QueryOverlap(const BVHNode& box, const LeafVisit& visit) const;
+
+	// Depth-first traversal. test(node) returns a 4-bit mask of the children to
+	// enter, visit(index) is called for every leaf that passes.
+	template <typename NodeTest, typename LeafVisit>
+	void Traverse(const NodeTest& test, const LeafVisit& visit) const;
+
+	static int OverlapMask(const BVH4Node& node, const BVHNode& box);
+
+private:
+	struct ChildPair
+	{
+		int32_t a;  // (a, a) asks for the pairs within the child a, (a, b) for the
+		int32_t b;  // pairs between a and b, both encoded like BVH4Node::child
+		int depth;
+	};
+
+	using PairEmitter = std::function<void(int i, int j, int thread)>;
+
+	int Collapse(const std::vector<BVHNode>& binary, int root, int level);
+	void Detect(WorkStealingPool& pool, const PairEmitter& emit) const;
+	void Traverse(ChildPair root, int spawnDepth, WorkStealingPool& pool, int thread, const PairEmitter& emit) const;
+	static BVHNode GetChildBounds(const BVH4Node& node, int k);
+};
+
+
+inline int BVH4::OverlapMask(const BVH4Node& node, const BVHNode& box)
+{
+#ifdef BVH4_USE_SSE
+	__m128 hit = _mm_and_ps(
+		_mm_and_ps(_mm_cmple_ps(_mm_load_ps(node.minX), _mm_set1_ps(box.maxX)), _mm_cmpge_ps(_mm_load_ps(node.maxX), _mm_set1_ps(box.minX))),
+		_mm_and_ps(_mm_cmple_ps(_mm_load_ps(node.minY), _mm_set1_ps(box.maxY)), _mm_cmpge_ps(_mm_load_ps(node.maxY), _mm_set1_ps(box.minY))));
+	hit = _mm_and_ps(hit,
+		_mm_and_ps(_mm_cmple_ps(_mm_load_ps(node.minZ), _mm_set1_ps(box.maxZ)), _mm_cmpge_ps(_mm_load_ps(node.maxZ), _mm_set1_ps(box.minZ))));
+	return _mm_movemask_ps(hit);
+#else
+	int mask = 0;
+	for (int k = 0; k < 4; k++)
+	{
+		bool hit = node.minX[k] <= box.maxX && node.maxX[k] >= box.minX
+			&& node.minY[k] <= box.maxY && node.maxY[k] >= box.minY
+			&& node.minZ[k] <= box.maxZ && node.maxZ[k] >= box.minZ;
+		mask |= int(hit) << k;
+	}
+	return mask;
+#endif
+}
+
+template <typename NodeTest, typename LeafVisit>
+void BVH4::Traverse(const NodeTest& test, const LeafVisit& visit) const
+{
+	if (nodes.empty()) return;
+
+	// a path keeps at most three pending siblings per level
+	int32_t localStack[256];
+	std::vector<int32_t> heapStack;
+	int32_t* stack = localStack;
+	if (3 * depth + 1 > 256)
+	{
+		heapStack.resize(3 * depth + 1);
+		stack = heapStack.data();
+	}
+
+	int top = 0;
+	stack[top++] = 0;
+	while (top > 0)
+	{
+		const BVH4Node& node = nodes[stack[--top]];
+		int mask = test(node);
+		for (int k = 0; k < 4; k++)
+		{
+			if (!(mask & (1 << k))) continue;
+			int32_t c = node.child[k];
+			if (BVH4Node::IsLeaf(c)) visit(BVH4Node::GetIndex(c));
+			else stack[top++] = c;
+		}
+	}
+}
+
+template <typename LeafVisit>
+void BVH4::QueryOverlap(const BVHNode& box, const LeafVisit& visit) const
+{
+	Traverse([&](const BVH4Node& node) { return OverlapMask(node, box); }, visit);
+}
@@ -1,25 +1,41 @@
 #include "BVHTree.h"
 
 #include <algorithm>
+#include <atomic>
+#include <cassert>
 #include <cmath>
 #include <limits>
 #include <iostream>
+#include <thread>
 
-const auto NaN = std::numeric_limits<double>::quiet_NaN();
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+#include <igl/parallel_for.h>
 
 using namespace Eigen;
 using std::min;
 using std::max;
 
+// round to the nearest float that is not greater (not less) than x
+static float RoundDown(double x)
+{
+	float f = static_cast<float>(x);
+	return (f > x) ? std::nextafter(f, -std::numeric_limits<float>::infinity()) : f;
+}
+
+static float RoundUp(double x)
+{
+	float f = static_cast<float>(x);
+	return (f < x) ? std::nextafter(f, std::numeric_limits<float>::infinity()) : f;
+}
+
 AABB::AABB(double minX, double minY, double minZ, double maxX, double maxY, double maxZ, int index)
 	: minX(minX), minY(minY), minZ(minZ)
 	, maxX(maxX), maxY(maxY), maxZ(maxZ)
 	, index(index)
 {
-	double width = maxX - minX;
-	double height = maxY - minY;
-	double depth = maxZ - minZ;
-	volume = width * height * depth;
 }
 
 AABB::AABB(const Vector3d& v, double epsilon, int index)
@@ -29,7 +45,7 @@ AABB::AABB(const Vector3d& v, double epsilon, int index)
 
 double AABB::GetVolume() const
 {
-	return volume;
+	return (maxX - minX) * (maxY - minY) * (maxZ - minZ);
 }
 
 AABB AABB::BB(const AABB & other) const
@@ -52,120 +68,149 @@ bool AABB::IsLeaf() const
 }
 
 
-
-TreeNode::TreeNode()
-	: aabb(NaN, NaN, NaN, NaN, NaN, NaN, -1)
-	, parent(nullptr), left(nullptr), right(nullptr), self_overlap_checked(false)
-{
-}
-
-TreeNode::~TreeNode()
+BVHNode::BVHNode(const AABB& aabb)
+	: minX(RoundDown(aabb.minX)), minY(RoundDown(aabb.minY)), minZ(RoundDown(aabb.minZ))
+	, maxX(RoundUp(aabb.maxX)), maxY(RoundUp(aabb.maxY)), maxZ(RoundUp(aabb.maxZ))
+	, left(-1), right(aabb.index)
 {
-	delete left;
-	delete right;
 }
 
-
-TreeNode* TreeNode::GetSibling() const
+float BVHNode::GetVolume() const
 {
-	assert(parent != nullptr);
-	return (parent->left == this) ? parent->right : parent->left;
+	return (maxX - minX) * (maxY - minY) * (maxZ - minZ);
 }
 
-
-void TreeNode::SetChild(TreeNode *left, TreeNode *right)
+BVHNode BVHNode::BB(const BVHNode& other) const
 {
-	this->left = left;
-	this->right = right;
-	left->parent = this;
-	right->parent = this;
-	aabb = left->aabb.BB(right->aabb);
+	BVHNode n;
+	n.minX = min(minX, other.minX);
+	n.minY = min(minY, other.minY);
+	n.minZ = min(minZ, other.minZ);
+	n.maxX = max(maxX, other.maxX);
+	n.maxY = max(maxY, other.maxY);
+	n.maxZ = max(maxZ, other.maxZ);
+	n.left = -1;
+	n.right = -1;
+	return n;
 }
 
-void TreeNode::Update()
+bool BVHNode::OverlapNode(const BVHNode& other) const
 {
-	if (left == nullptr)  // this node is a leaf
-	{
-		// do nothing
-		// TODO: maybe we need to maintain a margin of basic element
-	}
-	else
-	{
-		aabb = left->aabb.BB(right->aabb);
-	}
-
+	if (maxX < other.minX || minX > other.maxX) return false;
+	if (maxY < other.minY || minY > other.maxY) return false;
+	if (maxZ < other.minZ || minZ > other.maxZ) return false;
+	return true;
 }
 
 
-bool TreeNode::IsLeaf() const
-{
-	return (left == nullptr);
-}
 
-BVHTree::BVHTree() : root(nullptr) {}
-BVHTree::~BVHTree() { delete root; }
+BVHTree::BVHTree() : linked(false), epsilon(0.0), margin(0.0) {}
+BVHTree::~BVHTree() {}
 
 void BVHTree::Insert(AABB aabb)
 {
-	if (root == nullptr)
+	if (linked && aabb.index >= static_cast<int>(leafNodes.size()))
+		leafNodes.resize(aabb.index + 1, -1);
+
+	if (nodes.empty())
 	{
-		root = new TreeNode();
-		root->aabb = aabb;
+		nodes.emplace_back(aabb);
+		if (linked)
+		{
+			parents.assign(1, -1);
+			leafNodes[aabb.index] = 0;
+		}
 	}
 	else
 	{
-		TreeNode* n = new TreeNode();
-		n->aabb = aabb;
-		InsertNode(n, &root);
+		InsertNode(BVHNode(aabb));
 	}
 }
 
-void BVHTree::InsertNode(TreeNode* node, TreeNode** parent)
+int BVHTree::AllocateNode()
 {
-	TreeNode* p = *parent;
-	if (p->IsLeaf())
+	if (!freeNodes.empty())
 	{
-		TreeNode* new_parent = new TreeNode();
-		new_parent->parent = p->parent;
-		new_parent->SetChild(node, p);
-		*parent = new_parent;
+		int node = freeNodes.back();
+		freeNodes.pop_back();
+		return node;
 	}
-	else  // the parent to insert is an internal node
-	{     // we need to decide insert to left/right
-		auto& leftAabb = p->left->aabb;
-		auto& rightAabb = p->right->aabb;
-
-		double leftVol = leftAabb.GetVolume();
-		double rightVol = rightAabb.GetVolume();
+	nodes.emplace_back();
+	if (linked) parents.push_back(-1);
+	return static_cast<int>(nodes.size()) - 1;
+}
 
-		AABB leftInsertAabb = leftAabb.BB(node->aabb);
-		AABB rightInsertAabb = rightAabb.BB(node->aabb);
+void BVHTree::InsertNode(const BVHNode& leaf)
+{
+	int p = 0;
+	while (!nodes[p].IsLeaf())
+	{ // the parent to insert is an internal node
+	  // we need to decide insert to left/right
+		const auto& leftNode = nodes[nodes[p].left];
+		const auto& rightNode = nodes[nodes[p].right];
+
+		float leftVol = leftNode.GetVolume();
+		float rightVol = rightNode.GetVolume();
+
+		float leftInsertVol = leftNode.BB(leaf).GetVolume();
+		float rightInsertVol = rightNode.BB(leaf).GetVolume();
+
+		// every node on the path will contain the new leaf, so grow it on the way down
+		int next = (leftInsertVol - leftVol < rightInsertVol - rightVol) ? nodes[p].left : nodes[p].right;
+		BVHNode grown = nodes[p].BB(leaf);
+		grown.left = nodes[p].left;
+		grown.right = nodes[p].right;
+		nodes[p] = grown;
+		p = next;
+	}
 
-		double leftInsertVol = leftInsertAabb.GetVolume();
-		double rightInsertVol = rightInsertAabb.GetVolume();
+	// the reached leaf turns into an internal node in place, its old content and the
+	// new leaf move to two new slots, so the parent of p does not change
+	BVHNode old = nodes[p];
+	int32_t newLeaf = AllocateNode();
+	int32_t oldLeaf = AllocateNode();
+	nodes[newLeaf] = leaf;
+	nodes[oldLeaf] = old;
 
-		if (leftInsertVol - leftVol < rightInsertVol - rightVol)
-		{
-			InsertNode(node, &(p->left));
-		}
-		else
-		{
-			InsertNode(node, &(p->right));
-		}
+	BVHNode parent = old.BB(leaf);
+	parent.left = newLeaf;
+	parent.right = oldLeaf;
+	nodes[p] = parent;
 
-		// trick...
-		(*parent)->Update();
+	if (linked)
+	{
+		parents[newLeaf] = p;
+		parents[oldLeaf] = p;
+		leafNodes[leaf.GetIndex()] = newLeaf;
+		leafNodes[old.GetIndex()] = oldLeaf;
 	}
 }
 
 
 
-void BVHTree::Build(const MatrixXd& V, const MatrixXi& F, double epsilon)
+void BVHTree::Build(const MatrixXd& V, const MatrixXi& F, double epsilon, BuildMethod method)
 {
 	int numVertices = V.rows();
 
 	assert(numVertices > 0);
-	assert(root == nullptr);
+	assert(nodes.empty());
+
+	this->epsilon = epsilon;
+
+	// a binary tree with n leaves has exactly 2n-1 nodes
+	nodes.reserve(2 * numVertices - 1);
+
+	switch (method)
+	{
+	case BuildMethod::Incremental: BuildIncremental(V, epsilon); break;
+	case BuildMethod::BinnedSAH:   BuildBinnedSAH(V, epsilon);   break;
+	case BuildMethod::Morton:      BuildMorton(V, epsilon);      break;
+	}
+}
+
+void BVHTree::BuildIncremental(const MatrixXd& V, double epsilon)
+{
+	int numVertices = V.rows();
 
 	std::vector<int> indices;
 	indices.reserve(numVertices);
@@ -176,96 +221,573 @@ void BVHTree::Build(const MatrixXd& V, const MatrixXi& F, double epsilon)
 	{
 		Vector3d v = V.row(i);
 		AABB aabb(v, epsilon, i);
-		//std::cout << aabb.minX << "," << aabb.minY << "  " << aabb.maxX << "," << aabb.maxY << std::endl;
 		Insert(aabb);
 	}
 }
 
 
-void BVHTree::BroadPhaseDetect(CandidateIndexPairs& candiatePairs)
+// half of the surface area, the constant factor does not matter for the heuristic
+static float HalfArea(const BVHNode& n)
 {
-	std::vector<std::pair<AABB, AABB>> aabb_pairs;
+	float dx = n.maxX - n.minX;
+	float dy = n.maxY - n.minY;
+	float dz = n.maxZ - n.minZ;
+	return dx * dy + dy * dz + dz * dx;
+}
 
-	if (!root->IsLeaf())
-	{ // only one object...
-		ClearChecked(root);
-		SubtreeOverlap(root->left, root->right, aabb_pairs);
+static float Centroid(const BVHNode& n, int axis)
+{
+	switch (axis)
+	{
+	case 0:  return 0.5f * (n.minX + n.maxX);
+	case 1:  return 0.5f * (n.minY + n.maxY);
+	default: return 0.5f * (n.minZ + n.maxZ);
+	}
+}
+
+// Partitions prims[begin, end) and returns the first index of the right half.
+// Centroids are binned along the axis of largest extent and the bin boundary with
+// the lowest SAH cost is used, coincident centroids fall back to a median split.
+static int SplitBinnedSAH(const std::vector<BVHNode>& leaves, int* prims, int begin, int end)
+{
+	const int numBins = 16;
+
+	float cmin[3], cmax[3];
+	for (int k = 0; k < 3; k++)
+		cmin[k] = cmax[k] = Centroid(leaves[prims[begin]], k);
+	for (int i = begin + 1; i < end; i++)
+	{
+		for (int k = 0; k < 3; k++)
+		{
+			float c = Centroid(leaves[prims[i]], k);
+			cmin[k] = min(cmin[k], c);
+			cmax[k] = max(cmax[k], c);
+		}
+	}
+
+	int axis = 0;
+	for (int k = 1; k < 3; k++)
+		if (cmax[k] - cmin[k] > cmax[axis] - cmin[axis]) axis = k;
+
+	float extent = cmax[axis] - cmin[axis];
+	int mid = begin + (end - begin) / 2;
+	if (!(extent > 0.0f)) return mid;
+
+	const float scale = numBins / extent;
+	auto binOf = [&](int prim) {
+		int b = static_cast<int>((Centroid(leaves[prim], axis) - cmin[axis]) * scale);
+		return min(max(b, 0), numBins - 1);
+	};
+
+	int counts[numBins] = {};
+	BVHNode bounds[numBins];
+	for (int i = begin; i < end; i++)
+	{
+		int b = binOf(prims[i]);
+		bounds[b] = counts[b]++ ? bounds[b].BB(leaves[prims[i]]) : leaves[prims[i]];
 	}
 
+	// sweep from the right to get the cost of every right half, then from the left
+	float rightCost[numBins];
+	BVHNode acc;
+	int accCount = 0;
+	for (int b = numBins - 1; b > 0; b--)
+	{
+		if (counts[b]) acc = accCount ? acc.BB(bounds[b]) : bounds[b];
+		accCount += counts[b];
+		rightCost[b] = accCount ? HalfArea(acc) * accCount : 0.0f;
+	}
 
-	for (const auto& p : aabb_pairs)
+	int bestSplit = -1;
+	float bestCost = std::numeric_limits<float>::infinity();
+	accCount = 0;
+	for (int b = 0; b < numBins - 1; b++)
 	{
-		int idx1 = p.first.index;
-		int idx2 = p.second.index;
-		candiatePairs.emplace(min(idx1, idx2), max(idx1, idx2));
+		if (counts[b]) acc = accCount ? acc.BB(bounds[b]) : bounds[b];
+		accCount += counts[b];
+		if (accCount == 0 || accCount == end - begin) continue;
+		float cost = HalfArea(acc) * accCount + rightCost[b + 1];
+		if (cost < bestCost)
+		{
+			bestCost = cost;
+			bestSplit = b + 1;
+		}
 	}
+	if (bestSplit < 0) return mid;
 
+	int* it = std::partition(prims + begin, prims + end, [&](int prim) { return binOf(prim) < bestSplit; });
+	return static_cast<int>(it - prims);
 }
 
-void BVHTree::SelfOverlap(TreeNode* node, std::vector<std::pair<AABB, AABB>>& aabb_pairs)
+// Builds the subtree over prims[begin, end) rooted at nodes[node]. A subtree with m
+// leaves owns 2m-2 descendants, which are stored in nodes[base, base + 2m - 2): the
+// two children first, then the descendants of the left and of the right child.
+// Slots are therefore known up front and subtrees can be built independently.
+void BVHTree::BuildSubtree(const std::vector<BVHNode>& leaves, int* prims, int node, int base, int begin, int end)
 {
-	if (!node->self_overlap_checked)
+	if (end - begin == 1)
 	{
-		SubtreeOverlap(node->left, node->right, aabb_pairs);
-		node->self_overlap_checked = true;
+		nodes[node] = leaves[prims[begin]];
+		return;
 	}
+
+	int mid = SplitBinnedSAH(leaves, prims, begin, end);
+	int left = base;
+	int right = base + 1;
+	int leftBase = base + 2;
+	int rightBase = leftBase + 2 * (mid - begin) - 2;
+	BuildSubtree(leaves, prims, left, leftBase, begin, mid);
+	BuildSubtree(leaves, prims, right, rightBase, mid, end);
+
+	BVHNode n = nodes[left].BB(nodes[right]);
+	n.left = left;
+	n.right = right;
+	nodes[node] = n;
 }
 
-void BVHTree::SubtreeOverlap(TreeNode* node1, TreeNode* node2, std::vector<std::pair<AABB, AABB>>& aabb_pairs)
+void BVHTree::BuildBinnedSAH(const MatrixXd& V, double epsilon)
 {
-	bool overlap = node1->aabb.OverlapAABB(node2->aabb);
-	//bool overlap = true;
-	if (node1->IsLeaf())
+	int numVertices = V.rows();
+
+	std::vector<BVHNode> leaves(numVertices);
+	igl::parallel_for(numVertices, [&](int i) {
+		Vector3d v = V.row(i);
+		leaves[i] = BVHNode(AABB(v, epsilon, i));
+	}, 10000);
+
+	std::vector<int> prims(numVertices);
+	for (int i = 0; i < numVertices; i++) prims[i] = i;
+
+	nodes.resize(2 * numVertices - 1);
+
+	// Split the top levels serially until there are enough subtrees to keep every
+	// thread busy, then build those subtrees in parallel. The split decisions do not
+	// depend on the thread count, so the resulting tree is always the same.
+	struct Task { int node, base, begin, end; };
+	const int minTaskSize = 4096;
+	const size_t numTasks = 8 * max(1u, std::thread::hardware_concurrency());
+
+	std::vector<Task> tasks = { { 0, 1, 0, numVertices } };
+	std::vector<Task> splitTasks;  // parents, in top-down order
+	bool splitting = true;
+	while (splitting && tasks.size() < numTasks)
 	{
-		if (node2->IsLeaf())
+		splitting = false;
+		std::vector<Task> next;
+		for (const auto& t : tasks)
 		{
-			if (overlap)
+			if (t.end - t.begin < minTaskSize)
 			{
-				aabb_pairs.push_back(std::make_pair(node1->aabb, node2->aabb));
+				next.push_back(t);
+				continue;
 			}
+			int mid = SplitBinnedSAH(leaves, prims.data(), t.begin, t.end);
+			int leftBase = t.base + 2;
+			int rightBase = leftBase + 2 * (mid - t.begin) - 2;
+			next.push_back({ t.base, leftBase, t.begin, mid });
+			next.push_back({ t.base + 1, rightBase, mid, t.end });
+			splitTasks.push_back(t);
+			splitting = true;
 		}
-		else
+		tasks.swap(next);
+	}
+
+	igl::parallel_for(static_cast<int>(tasks.size()), [&](int i) {
+		const auto& t = tasks[i];
+		BuildSubtree(leaves, prims.data(), t.node, t.base, t.begin, t.end);
+	}, 2);
+
+	// children always come after their parent, so bottom-up is the reverse order
+	for (auto it = splitTasks.rbegin(); it != splitTasks.rend(); ++it)
+	{
+		int left = it->base;
+		int right = it->base + 1;
+		BVHNode n = nodes[left].BB(nodes[right]);
+		n.left = left;
+		n.right = right;
+		nodes[it->node] = n;
+	}
+}
+
+
+static int CountLeadingZeros(uint64_t x)
+{
+#ifdef _MSC_VER
+	unsigned long index;
+	return _BitScanReverse64(&index, x) ? 63 - static_cast<int>(index) : 64;
+#else
+	return x ? __builtin_clzll(x) : 64;
+#endif
+}
+
+// spreads the lower 21 bits of x so that there are two zero bits between each
+static uint64_t SpreadBits(uint64_t x)
+{
+	x &= 0x1fffff;
+	x = (x | x << 32) & 0x1f00000000ffffULL;
+	x = (x | x << 16) & 0x1f0000ff0000ffULL;
+	x = (x | x << 8) & 0x100f00f00f00f00fULL;
+	x = (x | x << 4) & 0x10c30c30c30c30c3ULL;
+	x = (x | x << 2) & 0x1249249249249249ULL;
+	return x;
+}
+
+// Stable LSD radix sort of keys (and values along with them), one byte per pass.
+// Every pass counts digits per chunk in parallel, takes the prefix sum over
+// (digit, chunk) and scatters each chunk in parallel into its own slots.
+static void RadixSort(std::vector<uint64_t>& keys, std::vector<int>& values, int numBits)
+{
+	const int n = static_cast<int>(keys.size());
+	const int radix = 256;
+	const int numChunks = std::max(1, std::min(64, n / 16384));
+	const int chunkSize = (n + numChunks - 1) / numChunks;
+
+	std::vector<uint64_t> keysTmp(n);
+	std::vector<int> valuesTmp(n);
+	std::vector<int> offsets(numChunks * radix);
+
+	for (int shift = 0; shift < numBits; shift += 8)
+	{
+		igl::parallel_for(numChunks, [&](int c) {
+			int* count = &offsets[c * radix];
+			std::fill(count, count + radix, 0);
+			for (int i = c * chunkSize; i < std::min(n, (c + 1) * chunkSize); i++)
+				count[(keys[i] >> shift) & 0xff]++;
+		}, 2);
+
+		int sum = 0;
+		for (int d = 0; d < radix; d++)
 		{
-			SelfOverlap(node2, aabb_pairs);
-			if (overlap)
+			for (int c = 0; c < numChunks; c++)
 			{
-				SubtreeOverlap(node1, node2->left, aabb_pairs);
-				SubtreeOverlap(node1, node2->right, aabb_pairs);
+				int count = offsets[c * radix + d];
+				offsets[c * radix + d] = sum;
+				sum += count;
 			}
 		}
+
+		igl::parallel_for(numChunks, [&](int c) {
+			int* cursor = &offsets[c * radix];
+			for (int i = c * chunkSize; i < std::min(n, (c + 1) * chunkSize); i++)
+			{
+				int dst = cursor[(keys[i] >> shift) & 0xff]++;
+				keysTmp[dst] = keys[i];
+				valuesTmp[dst] = values[i];
+			}
+		}, 2);
+
+		keys.swap(keysTmp);
+		values.swap(valuesTmp);
 	}
-	else
+}
+
+// Linear BVH after Karras, "Maximizing Parallelism in the Construction of BVHs,
+// Octrees, and k-d Trees" (HPG 2012). The n-1 inner nodes live in nodes[0, n-1) and
+// are emitted independently of each other, the n leaves follow in Morton order.
+void BVHTree::BuildMorton(const MatrixXd& V, double epsilon)
+{
+	const int numVertices = V.rows();
+
+	nodes.resize(2 * numVertices - 1);
+	if (numVertices == 1)
 	{
-		if (node2->IsLeaf())
+		Vector3d v = V.row(0);
+		nodes[0] = BVHNode(AABB(v, epsilon, 0));
+		return;
+	}
+
+	// quantize the vertices into a cube of 2^21 cells per side around the mesh
+	Vector3d lo = V.colwise().minCoeff();
+	Vector3d hi = V.colwise().maxCoeff();
+	double extent = (hi - lo).maxCoeff();
+	double scale = extent > 0.0 ? 2097151.0 / extent : 0.0;
+
+	std::vector<uint64_t> codes(numVertices);
+	std::vector<int> order(numVertices);
+	igl::parallel_for(numVertices, [&](int i) {
+		uint64_t q[3];
+		for (int k = 0; k < 3; k++)
+			q[k] = static_cast<uint64_t>((V(i, k) - lo[k]) * scale);
+		codes[i] = SpreadBits(q[0]) << 2 | SpreadBits(q[1]) << 1 | SpreadBits(q[2]);
+		order[i] = i;
+	}, 10000);
+
+	RadixSort(codes, order, 63);
+
+	// common prefix length of the keys at sorted positions i and j, vertices with
+	// the same code are told apart by their position
+	auto delta = [&](int i, int j) {
+		if (j < 0 || j >= numVertices) return -1;
+		uint64_t x = codes[i] ^ codes[j];
+		return x ? CountLeadingZeros(x) : 64 + CountLeadingZeros(static_cast<uint64_t>(i ^ j));
+	};
+
+	const int firstLeaf = numVertices - 1;
+	parents.assign(2 * numVertices - 1, -1);
+	leafNodes.resize(numVertices);
+
+	igl::parallel_for(numVertices, [&](int i) {
+		Vector3d v = V.row(order[i]);
+		BVHNode leaf(AABB(v, epsilon, order[i]));
+		nodes[firstLeaf + i] = leaf;
+		leafNodes[order[i]] = firstLeaf + i;
+	}, 10000);
+
+	igl::parallel_for(numVertices - 1, [&](int i) {
+		// direction of the range that starts at i
+		int d = (delta(i, i + 1) - delta(i, i - 1)) > 0 ? 1 : -1;
+
+		// exponential then binary search for the other end of the range
+		int deltaMin = delta(i, i - d);
+		int lmax = 2;
+		while (delta(i, i + lmax * d) > deltaMin) lmax <<= 1;
+		int l = 0;
+		for (int t = lmax >> 1; t > 0; t >>= 1)
+			if (delta(i, i + (l + t) * d) > deltaMin) l += t;
+		int j = i + l * d;
+
+		// binary search for the split, the last key sharing more than deltaNode bits with i
+		int deltaNode = delta(i, j);
+		int s = 0;
+		for (int t = (l + 1) >> 1; ; t = (t + 1) >> 1)
 		{
-			SelfOverlap(node1, aabb_pairs);
-			if (overlap)
-			{
-				SubtreeOverlap(node1->left, node2, aabb_pairs);
-				SubtreeOverlap(node1->right, node2, aabb_pairs);
-			}
+			if (delta(i, i + (s + t) * d) > deltaNode) s += t;
+			if (t == 1) break;
 		}
-		else
+		int gamma = i + s * d + std::min(d, 0);
+
+		int left = (std::min(i, j) == gamma) ? firstLeaf + gamma : gamma;
+		int right = (std::max(i, j) == gamma + 1) ? firstLeaf + gamma + 1 : gamma + 1;
+		nodes[i].left = left;
+		nodes[i].right = right;
+		parents[left] = i;
+		parents[right] = i;
+	}, 10000);
+
+	linked = true;
+	RefitBottomUp(leafNodes);
+}
+
+
+// parents and leafNodes for trees built without them
+void BVHTree::Link()
+{
+	if (linked) return;
+
+	parents.assign(nodes.size(), -1);
+	int numLeaves = 0;
+	for (const auto& n : nodes)
+		if (n.IsLeaf()) numLeaves = max(numLeaves, n.GetIndex() + 1);
+	leafNodes.assign(numLeaves, -1);
+
+	for (int i = 0; i < static_cast<int>(nodes.size()); i++)
+	{
+		const BVHNode& n = nodes[i];
+		if (!n.IsLeaf())
 		{
-			SelfOverlap(node1, aabb_pairs);
-			SelfOverlap(node2, aabb_pairs);
-			if (overlap)
-			{
-				SubtreeOverlap(node1->left, node2->left, aabb_pairs);
-				SubtreeOverlap(node1->left, node2->right, aabb_pairs);
-				SubtreeOverlap(node1->right, node2->left, aabb_pairs);
-				SubtreeOverlap(node1->right, node2->right, aabb_pairs);
-			}
+			parents[n.left] = i;
+			parents[n.right] = i;
+		}
+		else if (n.GetIndex() >= 0)
+		{
+			leafNodes[n.GetIndex()] = i;
 		}
 	}
+	linked = true;
+}
+
+// Every leaf walks towards the root, the first thread to arrive at a node stops
+// there and the second one, which sees both children done, computes its bounds
+// and moves on.
+void BVHTree::RefitBottomUp(const std::vector<int32_t>& leaves)
+{
+	std::vector<std::atomic<int>> arrivals(nodes.size());
+	for (auto& a : arrivals) a.store(0, std::memory_order_relaxed);
+
+	igl::parallel_for(static_cast<int>(leaves.size()), [&](int i) {
+		if (leaves[i] < 0) return;
+		int node = parents[leaves[i]];
+		while (node >= 0 && arrivals[node].fetch_add(1, std::memory_order_acq_rel) == 1)
+		{
+			BVHNode n = nodes[nodes[node].left].BB(nodes[nodes[node].right]);
+			n.left = nodes[node].left;
+			n.right = nodes[node].right;
+			nodes[node] = n;
+			node = parents[node];
+		}
+	}, 10000);
 }
 
-void BVHTree::ClearChecked(TreeNode *node)
+void BVHTree::RefitAncestors(int node)
 {
-	node->self_overlap_checked = false;
-	if (!node->IsLeaf())
+	for (; node >= 0; node = parents[node])
 	{
-		ClearChecked(node->left);
-		ClearChecked(node->right);
+		BVHNode n = nodes[nodes[node].left].BB(nodes[nodes[node].right]);
+		n.left = nodes[node].left;
+		n.right = nodes[node].right;
+		nodes[node] = n;
+	}
+}
+
+void BVHTree::Refit(const MatrixXd& U)
+{
+	Link();
+	assert(U.rows() >= static_cast<int>(leafNodes.size()));
+
+	igl::parallel_for(static_cast<int>(leafNodes.size()), [&](int i) {
+		if (leafNodes[i] < 0) return;
+		Vector3d v = U.row(i);
+		nodes[leafNodes[i]] = BVHNode(AABB(v, epsilon + margin, i));
+	}, 10000);
+
+	RefitBottomUp(leafNodes);
+}
+
+bool BVHTree::MoveLeaf(int index, const Vector3d& position)
+{
+	Link();
+	assert(index < static_cast<int>(leafNodes.size()) && leafNodes[index] >= 0);
+
+	const BVHNode& fat = nodes[leafNodes[index]];
+	BVHNode tight(AABB(position, epsilon, index));
+	if (tight.minX >= fat.minX && tight.minY >= fat.minY && tight.minZ >= fat.minZ &&
+		tight.maxX <= fat.maxX && tight.maxY <= fat.maxY && tight.maxZ <= fat.maxZ)
+		return false;
+
+	RemoveLeaf(index);
+	Insert(AABB(position, epsilon + margin, index));
+	return true;
+}
+
+void BVHTree::RemoveLeaf(int index)
+{
+	Link();
+	assert(index < static_cast<int>(leafNodes.size()) && leafNodes[index] >= 0);
+
+	int leaf = leafNodes[index];
+	leafNodes[index] = -1;
+
+	int parent = parents[leaf];
+	if (parent < 0)
+	{ // the last leaf
+		nodes.clear();
+		parents.clear();
+		freeNodes.clear();
+		return;
+	}
+
+	// the sibling takes the place of the parent, so the grandparent keeps its link
+	int sibling = (nodes[parent].left == leaf) ? nodes[parent].right : nodes[parent].left;
+	nodes[parent] = nodes[sibling];
+	if (nodes[parent].IsLeaf())
+	{
+		leafNodes[nodes[parent].GetIndex()] = parent;
+	}
+	else
+	{
+		parents[nodes[parent].left] = parent;
+		parents[nodes[parent].right] = parent;
+	}
+
+	for (int freed : { leaf, sibling })
+	{
+		nodes[freed].left = -1;
+		nodes[freed].right = -1;
+		freeNodes.push_back(freed);
+	}
+
+	RefitAncestors(parents[parent]);
+}
+
+int BVHTree::Update(const MatrixXd& U)
+{
+	Link();
+
+	int reinserted = 0;
+	for (int i = 0; i < static_cast<int>(leafNodes.size()); i++)
+	{
+		if (leafNodes[i] < 0) continue;
+		Vector3d v = U.row(i);
+		if (MoveLeaf(i, v)) reinserted++;
+	}
+	return reinserted;
+}
+
+
+void BVHTree::BroadPhaseDetect(CandidateIndexPairs& candiatePairs, int numThreads)
+{
+	WorkStealingPool pool(numThreads);
+	std::vector<std::vector<std::pair<int, int>>> buffers(pool.GetNumThreads());
+	Detect(pool, [&](int i, int j, int thread) { buffers[thread].emplace_back(i, j); });
+	MergeCandidatePairs(buffers, candiatePairs);
+}
+
+void BVHTree::BroadPhaseDetect(const CandidatePairVisitor& visitor, int numThreads)
+{
+	WorkStealingPool pool(numThreads);
+	Detect(pool, [&](int i, int j, int) { visitor(i, j); });
+}
+
+void BVHTree::Detect(WorkStealingPool& pool, const PairEmitter& emit) const
+{
+	if (nodes.empty() || nodes[0].IsLeaf()) return;  // only one object...
+
+	// node pairs in the top levels become tasks of their own, a few more levels than
+	// needed to feed every thread, so that stealing can even out unbalanced subtrees
+	int spawnDepth = 4;
+	for (int t = 1; t < pool.GetNumThreads(); t <<= 1) spawnDepth++;
+
+	pool.Run([&](int thread) { Traverse({ 0, 0, 0 }, spawnDepth, pool, thread, emit); });
+}
+
+void BVHTree::Traverse(NodePair root, int spawnDepth, WorkStealingPool& pool, int thread, const PairEmitter& emit) const
+{
+	std::vector<NodePair> stack;
+	auto push = [&](int a, int b, int depth) {
+		if (depth < spawnDepth)
+		{
+			NodePair p = { a, b, depth };
+			pool.Spawn(thread, [=, &pool, &emit](int t) { Traverse(p, spawnDepth, pool, t, emit); });
+		}
+		else
+		{
+			stack.push_back({ a, b, depth });
+		}
+	};
+
+	stack.push_back(root);
+	while (!stack.empty())
+	{
+		NodePair p = stack.back();
+		stack.pop_back();
+
+		const BVHNode& na = nodes[p.a];
+		const BVHNode& nb = nodes[p.b];
+		if (p.a == p.b)
+		{
+			if (na.IsLeaf()) continue;
+			push(na.left, na.left, p.depth + 1);
+			push(na.right, na.right, p.depth + 1);
+			push(na.left, na.right, p.depth + 1);
+		}
+		else if (na.OverlapNode(nb))
+		{
+			if (na.IsLeaf() && nb.IsLeaf())
+			{
+				int idx1 = na.GetIndex();
+				int idx2 = nb.GetIndex();
+				emit(min(idx1, idx2), max(idx1, idx2), thread);
+			}
+			else if (nb.IsLeaf() || (!na.IsLeaf() && na.GetVolume() > nb.GetVolume()))
+			{ // descend into the larger subtree
+				push(na.left, p.b, p.depth + 1);
+				push(na.right, p.b, p.depth + 1);
+			}
+			else
+			{
+				push(p.a, nb.left, p.depth + 1);
+				push(p.a, nb.right, p.depth + 1);
+			}
+		}
 	}
 }
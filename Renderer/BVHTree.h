@@ -1,11 +1,13 @@
 #pragma once
 
-#include <list>
-#include <set>
+#include <cstdint>
 #include <vector>
 
 #include <Eigen/Core>
 
+#include "BroadPhase.h"
+#include "WorkStealingPool.h"
+
 struct AABB
 {
 	double minX;
@@ -14,7 +16,6 @@ struct AABB
 	double maxX;
 	double maxY;
 	double maxZ;
-	double volume;
 	int index;  // vertex index
 
 	AABB(double minX, double minY, double minZ, double maxX, double maxY, double maxZ, int index);
@@ -26,53 +27,99 @@ struct AABB
 };
 
 
-struct TreeNode
+// Node of the flat tree, packed into 32 bytes so that two nodes share a cache line.
+// Bounds are single precision and rounded outwards, so a node box always contains
+// the double precision AABB it was made from.
+struct BVHNode
 {
-	friend class BVHTree;
-
-	union
-	{
-		TreeNode* pChild[3];
-		struct
-		{
-			TreeNode* parent;
-			TreeNode* left;
-			TreeNode* right;
-		};
-	};
-
-	bool self_overlap_checked;
-	AABB aabb;
-
-
-	TreeNode();
-	~TreeNode();
-
-private:
-	TreeNode * GetSibling() const;
-	bool IsLeaf() const;
-	void SetChild(TreeNode* left, TreeNode* right);
-	void Update();
+	float minX;
+	float minY;
+	float minZ;
+	float maxX;
+	float maxY;
+	float maxZ;
+	int32_t left;   // index of the left child, -1 for leaves
+	int32_t right;  // index of the right child, vertex index for leaves
+
+	BVHNode() = default;
+	explicit BVHNode(const AABB& aabb);
+
+	float GetVolume() const;
+	BVHNode BB(const BVHNode& other) const;
+	bool OverlapNode(const BVHNode& other) const;
+	bool IsLeaf() const { return left < 0; }
+	int GetIndex() const { return right; }
 };
 
+static_assert(sizeof(BVHNode) == 32, "BVHNode must stay packed into 32 bytes");
 
 
-using CandidateIndexPairs = std::set<std::pair<int, int>>;
-
+// All nodes live in one contiguous array, linked by 32-bit indices, the root is
+// always nodes[0]. The array is reserved once per build and released in one go.
+//
+// For deforming meshes the tree can be refitted or updated leaf by leaf. The parent
+// links this needs are only built on the first such call.
 class BVHTree
 {
-	TreeNode* root;
+	std::vector<BVHNode> nodes;
+	std::vector<int32_t> parents;    // parent of every node, -1 for the root
+	std::vector<int32_t> leafNodes;  // leaf node of every vertex, -1 if not in the tree
+	std::vector<int32_t> freeNodes;  // slots released by RemoveLeaf, reused by inserts
+	bool linked;                     // parents and leafNodes are up to date
+	double epsilon;
+	double margin;
 public:
+	enum class BuildMethod
+	{
+		Incremental,  // insert the vertices one by one in random order
+		BinnedSAH,    // top-down bulk build with binned surface area heuristic, deterministic
+		Morton,       // linear BVH over sorted 63-bit Morton codes, fastest to build, deterministic
+	};
+
 	BVHTree();
 	~BVHTree();
 
 	void Insert(AABB aabb);
-	void Build(const Eigen::MatrixXd& V, const Eigen::MatrixXi& F, double epsilon);
-	void BroadPhaseDetect(CandidateIndexPairs& candiatePairs);
+	void Build(const Eigen::MatrixXd& V, const Eigen::MatrixXi& F, double epsilon, BuildMethod method = BuildMethod::BinnedSAH);
+	// numThreads = 0 uses one thread per hardware thread
+	void BroadPhaseDetect(CandidateIndexPairs& candiatePairs, int numThreads = 0);
+	void BroadPhaseDetect(const CandidatePairVisitor& visitor, int numThreads = 0);
+
+	// Extra space around the leaf boxes of moved and inserted leaves. A leaf with a
+	// margin only has to be reinserted once its vertex leaves the fattened box.
+	void SetMargin(double margin) { this->margin = margin; }
+	// Recomputes every leaf box from U and all inner bounds bottom-up, in parallel,
+	// keeping the topology. U has the rows of the V the tree was built from.
+	void Refit(const Eigen::MatrixXd& U);
+	// Moves the leaf of vertex index to position, returns true if the new box did
+	// not fit into the fattened one and the leaf was reinserted.
+	bool MoveLeaf(int index, const Eigen::Vector3d& position);
+	void RemoveLeaf(int index);
+	// MoveLeaf for every row of U, returns the number of reinserted leaves.
+	int Update(const Eigen::MatrixXd& U);
+
+	// freed slots are marked as leaves with a negative vertex index
+	const std::vector<BVHNode>& GetNodes() const { return nodes; }
 
 private:
-	void InsertNode(TreeNode* node, TreeNode** parent);
-	void SelfOverlap(TreeNode* node, std::vector<std::pair<AABB, AABB>>& aabb_pairs);
-	void SubtreeOverlap(TreeNode* node1, TreeNode* node2, std::vector<std::pair<AABB, AABB>>& aabb_pairs);
-	void ClearChecked(TreeNode* node);
-};
\ No newline at end of file
+	struct NodePair
+	{
+		int a;      // (a, a) asks for the pairs within the subtree a,
+		int b;      // (a, b) for the pairs between the subtrees a and b
+		int depth;  // number of expansions from the root
+	};
+
+	void InsertNode(const BVHNode& leaf);
+	int AllocateNode();
+	void Link();
+	void RefitBottomUp(const std::vector<int32_t>& leaves);
+	void RefitAncestors(int node);
+	void BuildIncremental(const Eigen::MatrixXd& V, double epsilon);
+	void BuildBinnedSAH(const Eigen::MatrixXd& V, double epsilon);
+	void BuildMorton(const Eigen::MatrixXd& V, double epsilon);
+	void BuildSubtree(const std::vector<BVHNode>& leaves, int* prims, int node, int base, int begin, int end);
+	// emit(i, j, thread) is called for every overlapping pair of leaves
+	using PairEmitter = std::function<void(int i, int j, int thread)>;
+	void Detect(WorkStealingPool& pool, const PairEmitter& emit) const;
+	void Traverse(NodePair root, int spawnDepth, WorkStealingPool& pool, int thread, const PairEmitter& emit) const;
+};
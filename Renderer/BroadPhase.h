@@ -0,0 +1,30 @@
+#pragma once
+
+#include <algorithm>
+#include <functional>
+#include <utility>
+#include <vector>
+
+// Output shared by the broad phase structures (BVHTree, HashGrid): pairs of vertex
+// indices (i, j) with i < j whose bounds overlap and which need an exact check,
+// sorted and without duplicates.
+using CandidateIndexPairs = std::vector<std::pair<int, int>>;
+
+// Called once for every candidate pair (i, j), i < j, as soon as it is found. The
+// broad phases call it concurrently from their worker threads.
+using CandidatePairVisitor = std::function<void(int i, int j)>;
+
+// Concatenates per-thread pair buffers into one sorted, duplicate free array.
+inline void MergeCandidatePairs(std::vector<std::vector<std::pair<int, int>>>& buffers, CandidateIndexPairs& candiatePairs)
+{
+	size_t total = candiatePairs.size();
+	for (const auto& buffer : buffers) total += buffer.size();
+	candiatePairs.reserve(total);
+	for (auto& buffer : buffers)
+	{
+		candiatePairs.insert(candiatePairs.end(), buffer.begin(), buffer.end());
+		std::vector<std::pair<int, int>>().swap(buffer);
+	}
+	std::sort(candiatePairs.begin(), candiatePairs.end());
+	candiatePairs.erase(std::unique(candiatePairs.begin(), candiatePairs.end()), candiatePairs.end());
+}
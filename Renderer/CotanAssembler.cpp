@@ -0,0 +1,271 @@
+#include "CotanAssembler.h"
+#include "Parallel.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+#include <Eigen/StdVector>
+
+#include <igl/parallel_for.h>
+
+using namespace Eigen;
+
+namespace {
+
+// Kahan's Heron formula on the sorted edge lengths, as igl::doublearea(l, ...)
+inline double DoubleArea(double a, double b, double c)
+{
+	if (a < b) std::swap(a, b);
+	if (b < c) std::swap(b, c);
+	if (a < b) std::swap(a, b);
+	const double arg = (a + (b + c))*(c - (a - b))*(c + (a - b))*(a + (b - c));
+	const double dblA = 2.0*0.25*std::sqrt(arg);
+	return dblA == dblA ? dblA : 0.0;
+}
+
+} // namespace
+
+
+CotanAssembler::CotanAssembler() : numVertices(0)
+{
+}
+
+CotanAssembler::~CotanAssembler()
+{
+}
+
+void CotanAssembler::Analyze(const MatrixXi& F, int numVertices)
+{
+	assert(F.cols() == 3 && "CotanAssembler only handles triangles");
+	this->F = F;
+	this->numVertices = numVertices;
+	const int numFaces = F.rows();
+	const int n = numVertices;
+
+	// faces around every vertex, counting sort
+	vertexStart.assign(n + 1, 0);
+	for (int f = 0; f < numFaces; f++)
+		for (int k = 0; k < 3; k++) vertexStart[F(f, k) + 1]++;
+	for (int i = 0; i < n; i++) vertexStart[i + 1] += vertexStart[i];
+	vertexFaces.resize(vertexStart[n]);
+	{
+		std::vector<int> next(vertexStart.begin(), vertexStart.end() - 1);
+		for (int f = 0; f < numFaces; f++)
+			for (int k = 0; k < 3; k++) vertexFaces[next[F(f, k)]++] = f;
+	}
+
+	// (row, corner) of every off-diagonal contribution, bucketed by column; the edge
+	// opposite to corner k adds to (a, b) and (b, a)
+	std::vector<int> columnStart(n + 1, 0);
+	for (int f = 0; f < numFaces; f++)
+		for (int k = 0; k < 3; k++)
+		{
+			columnStart[F(f, (k + 1) % 3) + 1]++;
+			columnStart[F(f, (k + 2) % 3) + 1]++;
+		}
+	for (int i = 0; i < n; i++) columnStart[i + 1] += columnStart[i];
+	std::vector<std::pair<int, int>> entries(columnStart[n]);
+	{
+		std::vector<int> next(columnStart.begin(), columnStart.end() - 1);
+		for (int f = 0; f < numFaces; f++)
+			for (int k = 0; k < 3; k++)
+			{
+				const int a = F(f, (k + 1) % 3);
+				const int b = F(f, (k + 2) % 3);
+				entries[next[b]++] = std::make_pair(a, 3*f + k);
+				entries[next[a]++] = std::make_pair(b, 3*f + k);
+			}
+	}
+
+	// sort every column by row, equal rows share one nonzero, plus the diagonal
+	std::vector<int> numNonZeros(n);
+	igl::parallel_for(n, [&](int j) {
+		std::sort(entries.begin() + columnStart[j], entries.begin() + columnStart[j + 1]);
+		int count = 1;
+		for (int e = columnStart[j]; e < columnStart[j + 1]; e++)
+			if ((e == columnStart[j] || entries[e].first != entries[e - 1].first) && entries[e].first != j) count++;
+		numNonZeros[j] = count;
+	}, 1000);
+	const int nnz = Parallel::ExclusiveScan(numNonZeros);
+
+	outerStart.resize(n + 1);
+	std::copy(numNonZeros.begin(), numNonZeros.end(), outerStart.begin());
+	outerStart[n] = nnz;
+	innerIndices.resize(nnz);
+	diagonal.resize(n);
+	slotStart.resize(nnz + 1);
+	slotCorners.resize(entries.size());
+	slotStart[nnz] = static_cast<int>(entries.size());
+
+	// every contribution in a column ends up in the same column of slotCorners, in order
+	igl::parallel_for(n, [&](int j) {
+		int slot = outerStart[j];
+		int e = columnStart[j];
+		const int end = columnStart[j + 1];
+		bool diagonalDone = false;
+		while (e < end || !diagonalDone)
+		{
+			const int row = e < end ? entries[e].first : n;
+			if (!diagonalDone && j <= row)
+			{
+				// contributions of collapsed edges cancel out on the diagonal, they are
+				// kept with it but never gathered
+				innerIndices[slot] = j;
+				diagonal[j] = slot;
+				slotStart[slot++] = e;
+				for (; e < end && entries[e].first == j; e++) slotCorners[e] = entries[e].second;
+				diagonalDone = true;
+				continue;
+			}
+			innerIndices[slot] = row;
+			slotStart[slot++] = e;
+			for (; e < end && entries[e].first == row; e++) slotCorners[e] = entries[e].second;
+		}
+	}, 1000);
+}
+
+void CotanAssembler::ComputeFaceWeights(const MatrixXd& V, VectorXd& dblA, VectorXd& cot) const
+{
+	const int numFaces = F.rows();
+	dblA.resize(numFaces);
+	cot.resize(3*numFaces);
+	igl::parallel_for(numFaces, [&](int f) {
+		const int i0 = F(f, 0);
+		const int i1 = F(f, 1);
+		const int i2 = F(f, 2);
+		// squared edge lengths numbered as the opposite corners
+		double l2[3] = { 0, 0, 0 };
+		for (int d = 0; d < 3; d++)
+		{
+			const double e0 = V(i1, d) - V(i2, d);
+			const double e1 = V(i2, d) - V(i0, d);
+			const double e2 = V(i0, d) - V(i1, d);
+			l2[0] += e0*e0;
+			l2[1] += e1*e1;
+			l2[2] += e2*e2;
+		}
+		const double area = DoubleArea(std::sqrt(l2[0]), std::sqrt(l2[1]), std::sqrt(l2[2]));
+		dblA[f] = area;
+		cot[3*f + 0] = (l2[1] + l2[2] - l2[0]) / area / 4.0;
+		cot[3*f + 1] = (l2[2] + l2[0] - l2[1]) / area / 4.0;
+		cot[3*f + 2] = (l2[0] + l2[1] - l2[2]) / area / 4.0;
+	}, 1000);
+}
+
+void CotanAssembler::ComputeDoubleAreas(const MatrixXd& V, VectorXd& dblA) const
+{
+	const int numFaces = F.rows();
+	dblA.resize(numFaces);
+	igl::parallel_for(numFaces, [&](int f) {
+		double l[3];
+		for (int k = 0; k < 3; k++)
+		{
+			const int a = F(f, (k + 1) % 3);
+			const int b = F(f, (k + 2) % 3);
+			l[k] = (V.row(a) - V.row(b)).norm();
+		}
+		dblA[f] = DoubleArea(l[0], l[1], l[2]);
+	}, 1000);
+}
+
+void CotanAssembler::SetPattern(SparseMatrix<double>& L) const
+{
+	const int nnz = outerStart[numVertices];
+	L.resize(numVertices, numVertices);
+	L.resizeNonZeros(nnz);
+	std::memcpy(L.outerIndexPtr(), outerStart.data(), sizeof(int)*(numVertices + 1));
+	std::memcpy(L.innerIndexPtr(), innerIndices.data(), sizeof(int)*nnz);
+}
+
+void CotanAssembler::AssembleLaplacian(const VectorXd& cot, SparseMatrix<double>& L) const
+{
+	SetPattern(L);
+	double* values = L.valuePtr();
+	igl::parallel_for(numVertices, [&](int j) {
+		double sum = 0;
+		for (int s = outerStart[j]; s < outerStart[j + 1]; s++)
+		{
+			if (s == diagonal[j]) continue;
+			double value = 0;
+			for (int c = slotStart[s]; c < slotStart[s + 1]; c++) value += cot[slotCorners[c]];
+			values[s] = value;
+			sum += value;
+		}
+		values[diagonal[j]] = -sum;
+	}, 1000);
+}
+
+void CotanAssembler::AssembleLaplacian(const MatrixXd& V, SparseMatrix<double>& L) const
+{
+	VectorXd dblA;
+	VectorXd cot;
+	ComputeFaceWeights(V, dblA, cot);
+	AssembleLaplacian(cot, L);
+}
+
+void CotanAssembler::AssembleMass(const VectorXd& dblA, SparseMatrix<double>& M, double scale) const
+{
+	M.resize(numVertices, numVertices);
+	M.resizeNonZeros(numVertices);
+	int* outer = M.outerIndexPtr();
+	int* inner = M.innerIndexPtr();
+	double* values = M.valuePtr();
+	outer[numVertices] = numVertices;
+	igl::parallel_for(numVertices, [&](int i) {
+		double sum = 0;
+		for (int k = vertexStart[i]; k < vertexStart[i + 1]; k++) sum += dblA[vertexFaces[k]];
+		outer[i] = i;
+		inner[i] = i;
+		values[i] = sum * scale / 6.0;
+	}, 1000);
+}
+
+double CotanAssembler::ComputeMass(const MatrixXd& V, VectorXd& dblA, VectorXd& mass, RowVector3d& centroid, double scale) const
+{
+	const int numFaces = F.rows();
+	dblA.resize(numFaces);
+
+	// per thread sums of the areas and the area weighted face centroids
+	std::vector<Vector4d, aligned_allocator<Vector4d>> sums;
+	Vector4d total = Vector4d::Zero();
+	igl::parallel_for(numFaces,
+		[&](size_t numThreads) { sums.assign(numThreads, Vector4d::Zero()); },
+		[&](int f, size_t t) {
+			const int i0 = F(f, 0);
+			const int i1 = F(f, 1);
+			const int i2 = F(f, 2);
+			double l2[3] = { 0, 0, 0 };
+			double center[3];
+			for (int d = 0; d < 3; d++)
+			{
+				const double e0 = V(i1, d) - V(i2, d);
+				const double e1 = V(i2, d) - V(i0, d);
+				const double e2 = V(i0, d) - V(i1, d);
+				l2[0] += e0*e0;
+				l2[1] += e1*e1;
+				l2[2] += e2*e2;
+				center[d] = V(i0, d) + V(i1, d) + V(i2, d);
+			}
+			const double area = DoubleArea(std::sqrt(l2[0]), std::sqrt(l2[1]), std::sqrt(l2[2]));
+			dblA[f] = area;
+			sums[t] += area * Vector4d(1.0, center[0] / 3.0, center[1] / 3.0, center[2] / 3.0);
+		},
+		[&](size_t t) { total += sums[t]; },
+		1000);
+
+	centroid = total.tail<3>().transpose() / total[0];
+	const double area = 0.5*total[0];
+
+	mass.resize(numVertices);
+	const double factor = scale / area / 6.0;
+	igl::parallel_for(numVertices, [&](int i) {
+		double sum = 0;
+		for (int k = vertexStart[i]; k < vertexStart[i + 1]; k++) sum += dblA[vertexFaces[k]];
+		mass[i] = sum * factor;
+	}, 1000);
+	return area;
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <vector>
+
+#include <Eigen/Core>
+#include <Eigen/SparseCore>
+
+// Assembles the cotangent Laplacian (same values as igl::cotmatrix) and the
+// barycentric mass matrix (igl::massmatrix) of a fixed triangle mesh. The sparsity
+// pattern and, for every nonzero, the face corners contributing to it are computed
+// once in Analyze. Assembly is then a parallel pass over the faces for the per-face
+// weights and a parallel gather per column, written straight into the value array,
+// without triplets or sorting.
+class CotanAssembler
+{
+	int numVertices;
+	Eigen::MatrixXi F;
+	std::vector<int> outerStart;     // compressed column pattern of L, diagonal included
+	std::vector<int> innerIndices;
+	std::vector<int> diagonal;       // slot of (i, i) in every column
+	std::vector<int> slotStart;      // nonzero s gathers slotCorners[slotStart[s], slotStart[s + 1])
+	std::vector<int> slotCorners;    // corner 3*f + k stands for the edge opposite to corner k of face f
+	std::vector<int> vertexStart;    // vertex i gathers vertexFaces[vertexStart[i], vertexStart[i + 1])
+	std::vector<int> vertexFaces;
+
+public:
+	CotanAssembler();
+	~CotanAssembler();
+
+	// F: triangle indices
+	void Analyze(const Eigen::MatrixXi& F, int numVertices);
+
+	// dblA: twice the area of every face
+	// cot: half the cotangent of every corner, indexed by 3*f + k
+	void ComputeFaceWeights(const Eigen::MatrixXd& V, Eigen::VectorXd& dblA, Eigen::VectorXd& cot) const;
+	void ComputeDoubleAreas(const Eigen::MatrixXd& V, Eigen::VectorXd& dblA) const;
+
+	void AssembleLaplacian(const Eigen::VectorXd& cot, Eigen::SparseMatrix<double>& L) const;
+	void AssembleLaplacian(const Eigen::MatrixXd& V, Eigen::SparseMatrix<double>& L) const;
+	// scale: multiplies the areas, e.g. 1/area to get the mass of the normalized mesh
+	void AssembleMass(const Eigen::VectorXd& dblA, Eigen::SparseMatrix<double>& M, double scale = 1.0) const;
+	// Fused pass for smoothing: one sweep over the faces for their areas, the total
+	// area and the area weighted centroid, one over the vertices gathering the lumped
+	// barycentric mass diagonal (times scale / area). Returns the total area.
+	// dblA: workspace, twice the face areas on return
+	double ComputeMass(const Eigen::MatrixXd& V, Eigen::VectorXd& dblA, Eigen::VectorXd& mass,
+		Eigen::RowVector3d& centroid, double scale = 1.0) const;
+
+	int GetNumVertices() const { return numVertices; }
+	bool IsAnalyzed() const { return !outerStart.empty(); }
+
+private:
+	void SetPattern(Eigen::SparseMatrix<double>& L) const;
+};
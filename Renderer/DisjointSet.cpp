@@ -0,0 +1,39 @@
+#include "DisjointSet.h"
+
+#include <utility>
+
+ConcurrentDisjointSet::ConcurrentDisjointSet(int n) : parents(n)
+{
+	for (int i = 0; i < n; i++) parents[i].store(i, std::memory_order_relaxed);
+}
+
+int ConcurrentDisjointSet::Find(int x)
+{
+	for (;;)
+	{
+		int parent = parents[x].load(std::memory_order_acquire);
+		if (parent == x) return x;
+
+		// path halving: point x to its grandparent, losing the race is harmless
+		int grandparent = parents[parent].load(std::memory_order_acquire);
+		if (grandparent != parent)
+			parents[x].compare_exchange_weak(parent, grandparent, std::memory_order_acq_rel);
+		x = grandparent;
+	}
+}
+
+void ConcurrentDisjointSet::Union(int x, int y)
+{
+	for (;;)
+	{
+		x = Find(x);
+		y = Find(y);
+		if (x == y) return;
+		if (x > y) std::swap(x, y);
+
+		// y is a root only as long as it points to itself, retry if another thread
+		// linked it in the meantime
+		int expected = y;
+		if (parents[y].compare_exchange_strong(expected, x, std::memory_order_acq_rel)) return;
+	}
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <atomic>
+#include <vector>
+
+// Lock-free disjoint sets for unions from several threads. Roots are linked by
+// index, the larger under the smaller, with a compare-and-swap on the root, and
+// Find halves paths as it goes. Every set therefore ends up represented by its
+// smallest element, independently of the order of the unions.
+class ConcurrentDisjointSet
+{
+	std::vector<std::atomic<int>> parents;
+public:
+	explicit ConcurrentDisjointSet(int n);
+
+	int Find(int x);
+	void Union(int x, int y);
+	int GetNumElements() const { return static_cast<int>(parents.size()); }
+};
@@ -51,6 +51,25 @@ void FaceModel::LoadMesh(const MatrixXd & vertices, const MatrixXd& normals, con
 	if (normals.Options & Eigen::RowMajor) { nf = -normals.template cast<float>(); }
 	else { nf = -normals.transpose().template cast<float>(); }
 
+	Upload(vf, nf, indices);
+}
+
+void FaceModel::LoadMesh(const MatrixXf& vertices, const MatrixXf& normals, const MatrixXi& indices)
+{
+	MatrixXf vf;
+	if (vertices.Options & Eigen::RowMajor) { vf = vertices; }
+	else { vf = vertices.transpose(); }
+
+	MatrixXf nf;
+	// we need flip all normal manually;
+	if (normals.Options & Eigen::RowMajor) { nf = -normals; }
+	else { nf = -normals.transpose(); }
+
+	Upload(vf, nf, indices);
+}
+
+void FaceModel::Upload(const MatrixXf& vf, const MatrixXf& nf, const MatrixXi& indices)
+{
 	m_numIndex = indices.size();
 	MatrixXi idx;
 	if (indices.Options & Eigen::RowMajor) { idx = indices; }
@@ -14,8 +14,13 @@ public:
 	void Use();
 	void Draw();
 	void LoadMesh(const Eigen::MatrixXd& vertices, const Eigen::MatrixXd& normals, const Eigen::MatrixXi& indices);
+	// single precision input is uploaded without the conversion
+	void LoadMesh(const Eigen::MatrixXf& vertices, const Eigen::MatrixXf& normals, const Eigen::MatrixXi& indices);
 
 private:
+	// vf, nf: 3 by n, the layout of the vertex buffers
+	void Upload(const Eigen::MatrixXf& vf, const Eigen::MatrixXf& nf, const Eigen::MatrixXi& indices);
+
 	GLuint m_VAO;
 	GLuint m_IBO;
 	GLuint m_verticesVBO;
@@ -0,0 +1,115 @@
+#include "HashGrid.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+#include <igl/parallel_for.h>
+
+using namespace Eigen;
+
+// above this many cells per unit of coordinate the quotient x/cellSize is no
+// longer exact enough to tell neighbouring cells apart
+const double MAX_CELLS_PER_COORDINATE = 1099511627776.0;  // 2^40
+
+// 64-bit finalizer of MurmurHash3
+static uint64_t Mix(uint64_t h)
+{
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdULL;
+	h ^= h >> 33;
+	h *= 0xc4ceb9fe1a85ec53ULL;
+	h ^= h >> 33;
+	return h;
+}
+
+HashGrid::HashGrid() : cellSize(0), bucketMask(0) {}
+HashGrid::~HashGrid() {}
+
+uint64_t HashGrid::Bucket(const Cell& c) const
+{
+	uint64_t h = Mix(static_cast<uint64_t>(c.x));
+	h = Mix(h ^ static_cast<uint64_t>(c.y));
+	h = Mix(h ^ static_cast<uint64_t>(c.z));
+	return h & bucketMask;
+}
+
+void HashGrid::Build(const MatrixXd& V, double epsilon)
+{
+	int numVertices = V.rows();
+
+	assert(numVertices > 0);
+	assert(epsilon > 0);
+
+	// two vertices closer than epsilon are still in neighbouring cells of a coarser
+	// grid, the candidates are filtered by the caller
+	cellSize = std::max(epsilon, V.cwiseAbs().maxCoeff() / MAX_CELLS_PER_COORDINATE);
+
+	cells.resize(numVertices);
+	igl::parallel_for(numVertices, [&](int i) {
+		cells[i] = {
+			static_cast<int64_t>(std::floor(V(i, 0) / cellSize)),
+			static_cast<int64_t>(std::floor(V(i, 1) / cellSize)),
+			static_cast<int64_t>(std::floor(V(i, 2) / cellSize)) };
+	}, 10000);
+
+	// at least one bucket per vertex keeps the expected bucket size below one
+	uint64_t numBuckets = 1;
+	while (numBuckets < static_cast<uint64_t>(numVertices)) numBuckets <<= 1;
+	bucketMask = numBuckets - 1;
+
+	std::vector<uint32_t> buckets(numVertices);
+	igl::parallel_for(numVertices, [&](int i) {
+		buckets[i] = static_cast<uint32_t>(Bucket(cells[i]));
+	}, 10000);
+
+	// counting sort by bucket, stable so vertices stay ascending within a bucket
+	bucketStart.assign(numBuckets + 1, 0);
+	for (int i = 0; i < numVertices; i++) bucketStart[buckets[i] + 1]++;
+	for (uint64_t b = 0; b < numBuckets; b++) bucketStart[b + 1] += bucketStart[b];
+
+	bucketVertices.resize(numVertices);
+	std::vector<int> cursor(bucketStart.begin(), bucketStart.end() - 1);
+	for (int i = 0; i < numVertices; i++) bucketVertices[cursor[buckets[i]]++] = i;
+}
+
+// emit(j, i) is called for every earlier vertex j that is a candidate for i
+template <typename Emit>
+void HashGrid::QueryVertex(int i, const Emit& emit) const
+{
+	const Cell& c = cells[i];
+
+	for (int dz = -1; dz <= 1; dz++)
+	for (int dy = -1; dy <= 1; dy++)
+	for (int dx = -1; dx <= 1; dx++)
+	{
+		Cell n = { c.x + dx, c.y + dy, c.z + dz };
+		uint64_t b = Bucket(n);
+		for (int k = bucketStart[b]; k < bucketStart[b + 1]; k++)
+		{
+			int j = bucketVertices[k];
+			if (j >= i) break;
+			if (cells[j] == n) emit(j, i);
+		}
+	}
+}
+
+void HashGrid::BroadPhaseDetect(CandidateIndexPairs& candiatePairs)
+{
+	int numVertices = static_cast<int>(cells.size());
+
+	// every thread collects into its own buffer, merged afterwards
+	std::vector<std::vector<std::pair<int, int>>> buffers;
+	igl::parallel_for(numVertices,
+		[&](size_t numThreads) { buffers.resize(numThreads); },
+		[&](int i, size_t t) { QueryVertex(i, [&](int j, int k) { buffers[t].emplace_back(j, k); }); },
+		[](size_t) {},
+		10000);
+	MergeCandidatePairs(buffers, candiatePairs);
+}
+
+void HashGrid::BroadPhaseDetect(const CandidatePairVisitor& visitor)
+{
+	int numVertices = static_cast<int>(cells.size());
+	igl::parallel_for(numVertices, [&](int i) { QueryVertex(i, visitor); }, 10000);
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <Eigen/Core>
+
+#include "BroadPhase.h"
+
+// Uniform grid over the vertices with cells of size epsilon, stored as a hash table
+// bucketed by a counting sort (no per-cell allocation). Vertices closer than epsilon
+// are either in the same or in neighbouring cells, so a query is expected O(1).
+//
+// Cells are never smaller than 2^-40 of the largest coordinate, below that the
+// quotient x/cellSize is no longer exact enough to tell neighbouring cells apart.
+// A tiny epsilon then only makes the candidates coarser than needed; the caller's
+// distance check still decides, so no pair closer than epsilon is missed.
+class HashGrid
+{
+	struct Cell
+	{
+		int64_t x;
+		int64_t y;
+		int64_t z;
+
+		bool operator==(const Cell& other) const { return x == other.x && y == other.y && z == other.z; }
+	};
+
+	double cellSize;
+	uint64_t bucketMask;
+	std::vector<Cell> cells;          // cell of every vertex
+	std::vector<int> bucketStart;     // #buckets+1 offsets into bucketVertices
+	std::vector<int> bucketVertices;  // vertex indices sorted by bucket, ascending within a bucket
+
+public:
+	HashGrid();
+	~HashGrid();
+
+	void Build(const Eigen::MatrixXd& V, double epsilon);
+	void BroadPhaseDetect(CandidateIndexPairs& candiatePairs);
+	void BroadPhaseDetect(const CandidatePairVisitor& visitor);
+
+	double GetCellSize() const { return cellSize; }
+
+private:
+	uint64_t Bucket(const Cell& c) const;
+	template <typename Emit>
+	void QueryVertex(int i, const Emit& emit) const;
+};
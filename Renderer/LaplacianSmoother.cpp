@@ -0,0 +1,393 @@
+#include "LaplacianSmoother.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <iostream>
+#include <type_traits>
+#include <vector>
+
+#include <Eigen/OrderingMethods>
+#include <Eigen/IterativeLinearSolvers>
+#include <Eigen/SparseCholesky>
+#ifdef RENDERER_WITH_METIS
+#include <Eigen/MetisSupport>
+#endif
+
+#include <igl/parallel_for.h>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define LAPLACIAN_SMOOTHER_USE_SSE
+#include <xmmintrin.h>
+#endif
+
+using namespace Eigen;
+
+// orderings and preconditioners are template parameters, hide them behind an interface
+class LaplacianSmoother::LinearSolver
+{
+public:
+	virtual ~LinearSolver() {}
+	virtual void AnalyzePattern(const SparseMatrix<double>& S) = 0;
+	virtual bool Factorize(const SparseMatrix<double>& S) = 0;
+	// guess: starting point for iterative solvers
+	virtual MatrixXd Solve(const MatrixXd& B, const MatrixXd& guess) const = 0;
+	virtual int GetIterations() const { return 0; }
+};
+
+namespace {
+
+// Flushes denormals to zero on the calling thread while alive. The entries of a
+// single precision factor decay along the fill-in into the denormal range, where
+// every operation takes a slow path; without this a float solve is several times
+// slower than a double one.
+class FlushDenormals
+{
+#ifdef LAPLACIAN_SMOOTHER_USE_SSE
+	unsigned int csr;
+	bool enabled;
+public:
+	explicit FlushDenormals(bool enabled) : csr(_mm_getcsr()), enabled(enabled)
+	{
+		if (enabled) _mm_setcsr(csr | 0x8040);  // flush to zero, denormals are zero
+	}
+	~FlushDenormals()
+	{
+		if (enabled) _mm_setcsr(csr);
+	}
+#else
+public:
+	explicit FlushDenormals(bool) {}
+#endif
+};
+
+// S in the precision of the factorization, a copy only if that is not double
+template <typename Scalar>
+class Converted
+{
+	SparseMatrix<Scalar> matrix;
+public:
+	const SparseMatrix<Scalar>& operator()(const SparseMatrix<double>& S)
+	{
+		matrix = S.cast<Scalar>();
+		return matrix;
+	}
+};
+
+template <>
+class Converted<double>
+{
+public:
+	const SparseMatrix<double>& operator()(const SparseMatrix<double>& S) { return S; }
+};
+
+// Scalar: precision of the factor and of the back-substitution, float halves the
+// memory of the factor and the traffic of every solve
+template <typename OrderingType, typename Scalar>
+class SimplicialSolver : public LaplacianSmoother::LinearSolver
+{
+	SimplicialLLT<SparseMatrix<Scalar>, Lower, OrderingType> solver;
+	Converted<Scalar> converted;
+	static const bool flush = !std::is_same<Scalar, double>::value;
+public:
+	void AnalyzePattern(const SparseMatrix<double>& S) override { solver.analyzePattern(converted(S)); }
+	bool Factorize(const SparseMatrix<double>& S) override
+	{
+		FlushDenormals guard(flush);
+		solver.factorize(converted(S));
+		return solver.info() == Success;
+	}
+	MatrixXd Solve(const MatrixXd& B, const MatrixXd&) const override
+	{
+		// the coordinates are independent, back-substitute them concurrently
+		MatrixXd X(B.rows(), B.cols());
+		igl::parallel_for(B.cols(), [&](int c) {
+			FlushDenormals guard(flush);
+			X.col(c) = solver.solve(B.col(c).template cast<Scalar>()).template cast<double>();
+		}, 1);
+		return X;
+	}
+};
+
+// Iterative refinement around a low precision solver: the residual of every
+// correction is computed with S in double, the correction itself by the inner solver.
+class RefinedSolver : public LaplacianSmoother::LinearSolver
+{
+	std::unique_ptr<LaplacianSmoother::LinearSolver> inner;
+	const SparseMatrix<double>* S;
+	int steps;
+public:
+	RefinedSolver(std::unique_ptr<LaplacianSmoother::LinearSolver> inner, int steps)
+		: inner(std::move(inner)), S(nullptr), steps(steps)
+	{
+	}
+	void AnalyzePattern(const SparseMatrix<double>& S) override { inner->AnalyzePattern(S); }
+	bool Factorize(const SparseMatrix<double>& S) override
+	{
+		// keeps a reference to S for the residuals
+		this->S = &S;
+		return inner->Factorize(S);
+	}
+	MatrixXd Solve(const MatrixXd& B, const MatrixXd& guess) const override
+	{
+		MatrixXd X = inner->Solve(B, guess);
+		for (int k = 0; k < steps; k++)
+		{
+			const MatrixXd R = B - *S * X;
+			X += inner->Solve(R, R);
+		}
+		return X;
+	}
+};
+
+// Zero fill-in incomplete Cholesky, L L^T ~ S on the lower triangular pattern of S.
+// Written against Eigen's preconditioner interface, the IncompleteCholesky of the
+// unsupported module converges poorly on these systems and solves slowly.
+class ZeroFillIncompleteCholesky
+{
+	std::vector<int> colStart;  // column j of L is [colStart[j], colStart[j + 1]), diagonal first
+	std::vector<int> rows;
+	std::vector<double> values;
+public:
+	ZeroFillIncompleteCholesky() {}
+
+	template <typename MatrixType>
+	ZeroFillIncompleteCholesky& analyzePattern(const MatrixType& S)
+	{
+		const int n = static_cast<int>(S.cols());
+		colStart.assign(n + 1, 0);
+		rows.clear();
+		for (int j = 0; j < n; j++)
+		{
+			for (typename MatrixType::InnerIterator it(S, j); it; ++it)
+				if (it.row() >= j) rows.push_back(static_cast<int>(it.row()));
+			colStart[j + 1] = static_cast<int>(rows.size());
+		}
+		values.resize(rows.size());
+		return *this;
+	}
+
+	template <typename MatrixType>
+	ZeroFillIncompleteCholesky& factorize(const MatrixType& S)
+	{
+		const int n = static_cast<int>(S.cols());
+		for (int j = 0; j < n; j++)
+		{
+			int k = colStart[j];
+			for (typename MatrixType::InnerIterator it(S, j); it; ++it)
+				if (it.row() >= j) values[k++] = it.value();
+		}
+
+		// right-looking, updates only the entries already in the pattern
+		for (int k = 0; k < n; k++)
+		{
+			const int begin = colStart[k];
+			const int end = colStart[k + 1];
+			// S is SPD, a breakdown only happens through the dropped fill-in
+			double pivot = values[begin] > 0 ? std::sqrt(values[begin]) : 1.0;
+			values[begin] = pivot;
+			for (int p = begin + 1; p < end; p++) values[p] /= pivot;
+
+			for (int p = begin + 1; p < end; p++)
+			{
+				const int j = rows[p];
+				const double ljk = values[p];
+				// column j and column k below row j are sorted, merge them
+				int q = colStart[j];
+				for (int r = p; r < end; r++)
+				{
+					while (q < colStart[j + 1] && rows[q] < rows[r]) q++;
+					if (q == colStart[j + 1]) break;
+					if (rows[q] == rows[r]) values[q] -= values[r] * ljk;
+				}
+			}
+		}
+		return *this;
+	}
+
+	template <typename MatrixType>
+	ZeroFillIncompleteCholesky& compute(const MatrixType& S)
+	{
+		analyzePattern(S);
+		return factorize(S);
+	}
+
+	VectorXd solve(const VectorXd& b) const
+	{
+		const int n = static_cast<int>(colStart.size()) - 1;
+		VectorXd x = b;
+		for (int j = 0; j < n; j++)
+		{
+			x[j] /= values[colStart[j]];
+			for (int p = colStart[j] + 1; p < colStart[j + 1]; p++) x[rows[p]] -= values[p] * x[j];
+		}
+		for (int j = n - 1; j >= 0; j--)
+		{
+			double sum = x[j];
+			for (int p = colStart[j] + 1; p < colStart[j + 1]; p++) sum -= values[p] * x[rows[p]];
+			x[j] = sum / values[colStart[j]];
+		}
+		return x;
+	}
+
+	ComputationInfo info() const { return Success; }
+};
+
+template <typename PreconditionerType>
+class ConjugateGradientSolver : public LaplacianSmoother::LinearSolver
+{
+	ConjugateGradient<SparseMatrix<double>, Lower, PreconditionerType> solver;
+public:
+	ConjugateGradientSolver(double tolerance, int maxIterations)
+	{
+		solver.setTolerance(tolerance);
+		solver.setMaxIterations(maxIterations);
+	}
+	void AnalyzePattern(const SparseMatrix<double>& S) override { solver.analyzePattern(S); }
+	bool Factorize(const SparseMatrix<double>& S) override
+	{
+		// keeps a reference to S and rebuilds the preconditioner
+		solver.factorize(S);
+		return solver.info() == Success;
+	}
+	MatrixXd Solve(const MatrixXd& B, const MatrixXd& guess) const override
+	{
+		// one column after the other, the solver keeps per solve statistics
+		MatrixXd X = solver.solveWithGuess(B, guess);
+		if (solver.info() != Success)
+			std::cerr << "CG did not converge, error " << solver.error() << std::endl;
+		return X;
+	}
+	int GetIterations() const override { return solver.iterations(); }
+};
+
+template <typename OrderingType>
+std::unique_ptr<LaplacianSmoother::LinearSolver> MakeCholesky(const LaplacianSmoother::Options& options)
+{
+	using Precision = LaplacianSmoother::Precision;
+
+	switch (options.precision)
+	{
+	case Precision::Single:
+		return std::make_unique<SimplicialSolver<OrderingType, float>>();
+	case Precision::Mixed:
+		return std::make_unique<RefinedSolver>(std::make_unique<SimplicialSolver<OrderingType, float>>(), options.refinementSteps);
+	case Precision::Double:
+	default:
+		return std::make_unique<SimplicialSolver<OrderingType, double>>();
+	}
+}
+
+std::unique_ptr<LaplacianSmoother::LinearSolver> MakeSolver(const LaplacianSmoother::Options& options)
+{
+	using Solver = LaplacianSmoother::Solver;
+	using Ordering = LaplacianSmoother::Ordering;
+	using Preconditioner = LaplacianSmoother::Preconditioner;
+
+	if (options.solver == Solver::ConjugateGradient)
+	{
+		if (options.preconditioner == Preconditioner::IncompleteCholesky)
+			return std::make_unique<ConjugateGradientSolver<ZeroFillIncompleteCholesky>>(options.tolerance, options.maxIterations);
+		return std::make_unique<ConjugateGradientSolver<DiagonalPreconditioner<double>>>(options.tolerance, options.maxIterations);
+	}
+
+	switch (options.ordering)
+	{
+	case Ordering::Natural:
+		return MakeCholesky<NaturalOrdering<int>>(options);
+	case Ordering::COLAMD:
+		return MakeCholesky<COLAMDOrdering<int>>(options);
+	case Ordering::NestedDissection:
+#ifdef RENDERER_WITH_METIS
+		return MakeCholesky<MetisOrdering<int>>(options);
+#else
+		std::cerr << "Built without METIS, falling back to AMD ordering" << std::endl;
+		return MakeCholesky<AMDOrdering<int>>(options);
+#endif
+	case Ordering::AMD:
+	default:
+		return MakeCholesky<AMDOrdering<int>>(options);
+	}
+}
+
+} // namespace
+
+
+LaplacianSmoother::LaplacianSmoother() : iterations(0)
+{
+}
+
+LaplacianSmoother::LaplacianSmoother(const Options& options) : options(options), iterations(0)
+{
+}
+
+LaplacianSmoother::~LaplacianSmoother()
+{
+}
+
+void LaplacianSmoother::Analyze(const MatrixXi& F, const SparseMatrix<double>& L)
+{
+	assembler.Analyze(F, L.rows());
+
+	// S = M - coeff*L has the pattern of L plus the diagonal, keep -coeff*L in that
+	// pattern and the slots of the diagonal, every step only adds the masses
+	SparseMatrix<double> I(L.rows(), L.cols());
+	I.setIdentity();
+	S = I - options.coeff*L;
+	const int n = S.cols();
+	diagonal.assign(n, -1);
+	for (int j = 0; j < n; j++)
+		for (int k = S.outerIndexPtr()[j]; k < S.outerIndexPtr()[j + 1]; k++)
+			if (S.innerIndexPtr()[k] == j) diagonal[j] = k;
+	scaledL = Map<const VectorXd>(S.valuePtr(), S.nonZeros());
+	for (int j = 0; j < n; j++) scaledL[diagonal[j]] -= 1.0;
+
+	solver = MakeSolver(options);
+	solver->AnalyzePattern(S);
+}
+
+void LaplacianSmoother::Smooth(MatrixXd& U)
+{
+	Steps(U, 1);
+}
+
+void LaplacianSmoother::Smooth(MatrixXd& U, int iterations)
+{
+	const int lag = std::max(1, options.lagSteps);
+	for (int done = 0; done < iterations; done += lag)
+		Steps(U, std::min(lag, iterations - done));
+}
+
+void LaplacianSmoother::Steps(MatrixXd& U, int steps)
+{
+	assert(solver && "Analyze must be called before Smooth");
+
+	// Compute area, centroid and the masses of the normalized mesh in one go
+	RowVector3d centroid;
+	const double area = assembler.ComputeMass(U, dblA, mass, centroid);
+	// subtract the centroid and normalize to unit surface area (important for numerics)
+	const double scale = sqrt(area);
+	U = (U.rowwise() - centroid) / scale;
+
+	// S = M - delta*L, written into the analyzed pattern
+	Map<VectorXd> values(S.valuePtr(), S.nonZeros());
+	values = scaledL;
+	const int n = S.cols();
+	igl::parallel_for(n, [&](int i) {
+		values[diagonal[i]] += mass[i];
+	}, 10000);
+
+	// Solve (M-delta*L) U = M*U, reusing the symbolic analysis, CG starts from U
+	bool factorized = solver->Factorize(S);
+	assert(factorized);
+	(void)factorized;
+	iterations = 0;
+	for (int k = 0; k < steps; k++)
+	{
+		U = solver->Solve(mass.asDiagonal()*U, U);
+		iterations += solver->GetIterations();
+	}
+
+	// restore the original dimension
+	U = (U*scale).rowwise() + centroid;
+}
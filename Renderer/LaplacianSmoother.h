@@ -0,0 +1,98 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include <Eigen/Core>
+#include <Eigen/SparseCore>
+
+#include "CotanAssembler.h"
+
+// Implicit mean curvature flow, (M - coeff*L) U' = M U, kept across iterations.
+// The sparsity pattern of M - coeff*L is the one of L, so its ordering and symbolic
+// factorization are computed once in Analyze and every Smooth only refactorizes
+// numerically with the new mass matrix. Alternatively the system is solved with
+// preconditioned conjugate gradients, for small steps it is close to M and CG
+// converges in a handful of iterations without any fill-in. The factor can be kept
+// in single precision, optionally refined back to double accuracy.
+class LaplacianSmoother
+{
+public:
+	// fill-reducing ordering of the Cholesky factorization
+	enum class Ordering
+	{
+		AMD,               // approximate minimum degree, Eigen's default
+		Natural,           // no reordering, huge fill on anything but tiny meshes
+		COLAMD,            // column approximate minimum degree, made for unsymmetric matrices, much slower here
+		NestedDissection,  // METIS, pays off on large meshes, AMD if built without RENDERER_WITH_METIS
+	};
+
+	enum class Solver
+	{
+		Cholesky,           // sparse direct solver
+		ConjugateGradient,  // iterative, warm-started from the current vertices
+	};
+
+	// scalar type of the Cholesky factor, the system itself is always assembled in double
+	enum class Precision
+	{
+		Double,
+		Single,  // half the memory of the factor, errors around 1e-4 of a step
+		Mixed,   // single precision factor, residuals corrected in double
+	};
+
+	enum class Preconditioner
+	{
+		Jacobi,              // diagonal, cheapest to set up
+		IncompleteCholesky,  // zero fill-in Cholesky, fewer but costlier iterations
+	};
+
+	struct Options
+	{
+		double coeff = 0.00002;
+		Solver solver = Solver::Cholesky;
+		Ordering ordering = Ordering::AMD;                       // Cholesky only
+		Precision precision = Precision::Double;                 // Cholesky only
+		int refinementSteps = 1;                                 // Cholesky only, Mixed precision
+		Preconditioner preconditioner = Preconditioner::Jacobi;  // CG only
+		double tolerance = 1e-10;                                // CG only, relative residual
+		int maxIterations = 200;                                 // CG only
+		// Smooth(U, iterations) keeps the normalization and the mass matrix fixed for
+		// this many steps, so one factorization serves all of them; 1 is exact, more
+		// lags behind where the surface changes fast, e.g. at open boundaries
+		int lagSteps = 1;
+	};
+
+	LaplacianSmoother();
+	explicit LaplacianSmoother(const Options& options);
+	~LaplacianSmoother();
+
+	// F: indices
+	// L: precomputed Laplace-Beltrami operator of the mesh
+	void Analyze(const Eigen::MatrixXi& F, const Eigen::SparseMatrix<double>& L);
+	// U: vertices input & output, one smoothing step
+	void Smooth(Eigen::MatrixXd& U);
+	// iterations steps, refactorizing every Options::lagSteps steps
+	void Smooth(Eigen::MatrixXd& U, int iterations);
+
+	bool IsAnalyzed() const { return static_cast<bool>(solver); }
+	const Options& GetOptions() const { return options; }
+	// CG iterations of the last call, 0 for Cholesky
+	int GetIterations() const { return iterations; }
+
+	class LinearSolver;
+
+private:
+	// steps solves with the normalization and mass matrix of the first one
+	void Steps(Eigen::MatrixXd& U, int steps);
+
+	Options options;
+	CotanAssembler assembler;       // areas, centroid and masses of every step
+	Eigen::SparseMatrix<double> S;  // M - coeff*L of the last step, referenced by CG
+	Eigen::VectorXd scaledL;        // values of -coeff*L in the pattern of S
+	std::vector<int> diagonal;      // slots of the diagonal of S
+	Eigen::VectorXd dblA;           // workspaces of every step
+	Eigen::VectorXd mass;
+	std::unique_ptr<LinearSolver> solver;
+	int iterations;
+};
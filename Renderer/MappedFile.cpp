@@ -0,0 +1,112 @@
+#include "MappedFile.h"
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+
+MappedFile::MappedFile()
+	: data(nullptr), size(0), open(false), file(INVALID_HANDLE_VALUE), mapping(nullptr)
+{
+}
+
+bool MappedFile::Open(const std::string& path)
+{
+	Close();
+	file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+		FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (file == INVALID_HANDLE_VALUE) return false;
+
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(file, &fileSize))
+	{
+		Close();
+		return false;
+	}
+	size = static_cast<size_t>(fileSize.QuadPart);
+	open = true;
+	// a zero sized file can not be mapped
+	if (size == 0) return true;
+
+	mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (mapping) data = static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+	if (!data)
+	{
+		Close();
+		return false;
+	}
+	return true;
+}
+
+void MappedFile::Close()
+{
+	if (data) UnmapViewOfFile(data);
+	if (mapping) CloseHandle(mapping);
+	if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+	data = nullptr;
+	size = 0;
+	open = false;
+	file = INVALID_HANDLE_VALUE;
+	mapping = nullptr;
+}
+
+#else
+
+MappedFile::MappedFile()
+	: data(nullptr), size(0), open(false), file(-1)
+{
+}
+
+bool MappedFile::Open(const std::string& path)
+{
+	Close();
+	file = ::open(path.c_str(), O_RDONLY);
+	if (file < 0) return false;
+
+	struct stat status;
+	if (fstat(file, &status) != 0)
+	{
+		Close();
+		return false;
+	}
+	size = static_cast<size_t>(status.st_size);
+	open = true;
+	// a zero sized file can not be mapped
+	if (size == 0) return true;
+
+	void* address = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, file, 0);
+	if (address == MAP_FAILED)
+	{
+		Close();
+		return false;
+	}
+	data = static_cast<const char*>(address);
+	madvise(address, size, MADV_SEQUENTIAL);
+	return true;
+}
+
+void MappedFile::Close()
+{
+	if (data) munmap(const_cast<char*>(data), size);
+	if (file >= 0) ::close(file);
+	data = nullptr;
+	size = 0;
+	open = false;
+	file = -1;
+}
+
+#endif
+
+MappedFile::~MappedFile()
+{
+	Close();
+}
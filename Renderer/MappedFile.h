@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+// Read-only memory mapping of a whole file, unmapped on destruction. The pages are
+// loaded by the OS on first touch, so threads reading disjoint ranges also share
+// the I/O. The mapping is not null-terminated.
+class MappedFile
+{
+public:
+	MappedFile();
+	~MappedFile();
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	// returns false if the file can not be opened or mapped, an empty file maps to
+	// size 0 and a null data pointer
+	bool Open(const std::string& path);
+	void Close();
+
+	bool IsOpen() const { return open; }
+	const char* GetData() const { return data; }
+	size_t GetSize() const { return size; }
+
+private:
+	const char* data;
+	size_t size;
+	bool open;
+#ifdef _WIN32
+	void* file;     // HANDLE
+	void* mapping;  // HANDLE
+#else
+	int file;
+#endif
+};
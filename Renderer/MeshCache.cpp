@@ -0,0 +1,220 @@
+#include "MeshCache.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <vector>
+
+#include <igl/parallel_for.h>
+
+using namespace Eigen;
+
+namespace {
+
+const char magic[8] = { 'V', 'R', 'N', 'M', 'E', 'S', 'H', '\0' };
+const uint64_t alignment = 64;
+
+enum Section { SectionV, SectionF, SectionI, SectionN, SectionLp, SectionLi, SectionLx, NumSections };
+
+inline uint64_t SplitMix64(uint64_t x)
+{
+	x += 0x9E3779B97F4A7C15ull;
+	x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+	x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+	return x ^ (x >> 31);
+}
+
+inline uint64_t Align(uint64_t offset)
+{
+	return (offset + alignment - 1) / alignment * alignment;
+}
+
+} // namespace
+
+
+MeshCache::MeshCache()
+{
+	memset(&header, 0, sizeof(header));
+}
+
+MeshCache::~MeshCache()
+{
+}
+
+uint64_t MeshCache::Hash(const char* data, size_t size)
+{
+	// the words are little endian, the last one padded with zeros
+	const int64_t numWords = (size + 7) / 8;
+	const int64_t wordsPerChunk = 1 << 16;
+	const int numChunks = static_cast<int>((numWords + wordsPerChunk - 1) / wordsPerChunk);
+	std::vector<uint64_t> sums(numChunks, 0);
+	igl::parallel_for(numChunks, [&](int c) {
+		const int64_t begin = c * wordsPerChunk;
+		const int64_t end = std::min(numWords, begin + wordsPerChunk);
+		uint64_t sum = 0;
+		for (int64_t i = begin; i < end; i++)
+		{
+			uint64_t word = 0;
+			memcpy(&word, data + 8 * i, std::min<size_t>(8, size - 8 * i));
+			sum += SplitMix64(word + static_cast<uint64_t>(i) * 0xD6E8FEB86659FD93ull);
+		}
+		sums[c] = sum;
+	}, 1);
+
+	uint64_t sum = 0;
+	for (uint64_t s : sums) sum += s;
+	return SplitMix64(sum ^ static_cast<uint64_t>(size));
+}
+
+bool MeshCache::HashFile(const std::string& path, uint64_t& hash)
+{
+	MappedFile source;
+	if (!source.Open(path)) return false;
+	hash = Hash(source.GetData(), source.GetSize());
+	return true;
+}
+
+bool MeshCache::Open(const std::string& path, const Key& key)
+{
+	Close();
+	if (!file.Open(path) || file.GetSize() < sizeof(Header))
+	{
+		Close();
+		return false;
+	}
+	memcpy(&header, file.GetData(), sizeof(Header));
+
+	const int64_t nnz = HasLaplacian() ? header.laplacianNonZeros : 0;
+	const uint64_t sizes[NumSections] = {
+		static_cast<uint64_t>(header.numVertices) * 3 * sizeof(double),
+		static_cast<uint64_t>(header.numFaces) * 3 * sizeof(int),
+		static_cast<uint64_t>(header.numRawVertices) * sizeof(int),
+		HasNormals() ? static_cast<uint64_t>(header.numVertices) * 3 * sizeof(float) : 0,
+		HasLaplacian() ? static_cast<uint64_t>(header.numVertices + 1) * sizeof(int) : 0,
+		static_cast<uint64_t>(nnz) * sizeof(int),
+		static_cast<uint64_t>(nnz) * sizeof(double),
+	};
+	bool valid = memcmp(header.magic, magic, sizeof(magic)) == 0 && header.version == version
+		&& header.sourceHash == key.sourceHash && header.weldEpsilon == key.weldEpsilon && header.iso == key.iso
+		&& header.numVertices >= 0 && header.numFaces >= 0
+		&& header.numRawVertices >= 0 && nnz >= 0;
+	for (int s = 0; s < NumSections && valid; s++)
+	{
+		if (sizes[s] == 0) continue;
+		valid = header.offsets[s] % alignment == 0 && header.offsets[s] >= sizeof(Header)
+			&& header.offsets[s] + sizes[s] <= file.GetSize();
+	}
+	if (!valid) Close();
+	return valid;
+}
+
+void MeshCache::Close()
+{
+	file.Close();
+	memset(&header, 0, sizeof(header));
+}
+
+bool MeshCache::Write(const std::string& path, const Key& key, const MatrixXd& V, const MatrixXi& F,
+	const VectorXi& I, const MatrixXd* N, const SparseMatrix<double>* L)
+{
+	Header header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, magic, sizeof(magic));
+	header.version = version;
+	header.flags = (N ? uint32_t(Flags::FlagNormals) : uint32_t(0)) | (L ? uint32_t(Flags::FlagLaplacian) : uint32_t(0));
+	header.sourceHash = key.sourceHash;
+	header.weldEpsilon = key.weldEpsilon;
+	header.iso = key.iso;
+	header.numVertices = V.rows();
+	header.numFaces = F.rows();
+	header.numRawVertices = I.size();
+
+	const Faces faces = F;
+	Normals normals;
+	if (N) normals = N->cast<float>();
+	SparseMatrix<double> laplacian;
+	if (L)
+	{
+		laplacian = *L;
+		laplacian.makeCompressed();
+		header.laplacianNonZeros = laplacian.nonZeros();
+	}
+
+	const char* data[NumSections] = {
+		reinterpret_cast<const char*>(V.data()),
+		reinterpret_cast<const char*>(faces.data()),
+		reinterpret_cast<const char*>(I.data()),
+		reinterpret_cast<const char*>(normals.data()),
+		reinterpret_cast<const char*>(laplacian.outerIndexPtr()),
+		reinterpret_cast<const char*>(laplacian.innerIndexPtr()),
+		reinterpret_cast<const char*>(laplacian.valuePtr()),
+	};
+	const uint64_t sizes[NumSections] = {
+		static_cast<uint64_t>(V.size()) * sizeof(double),
+		static_cast<uint64_t>(faces.size()) * sizeof(int),
+		static_cast<uint64_t>(I.size()) * sizeof(int),
+		static_cast<uint64_t>(normals.size()) * sizeof(float),
+		L ? static_cast<uint64_t>(laplacian.outerSize() + 1) * sizeof(int) : 0,
+		static_cast<uint64_t>(header.laplacianNonZeros) * sizeof(int),
+		static_cast<uint64_t>(header.laplacianNonZeros) * sizeof(double),
+	};
+	uint64_t offset = sizeof(Header);
+	for (int s = 0; s < NumSections; s++)
+	{
+		if (sizes[s] == 0) continue;
+		offset = Align(offset);
+		header.offsets[s] = offset;
+		offset += sizes[s];
+	}
+
+	// written next to the target and renamed, a reader never sees half a cache
+	const std::string temporary = path + ".tmp";
+	{
+		std::ofstream out(temporary, std::ios::binary);
+		if (!out) return false;
+		out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		uint64_t position = sizeof(Header);
+		const char zeros[alignment] = {};
+		for (int s = 0; s < NumSections; s++)
+		{
+			if (sizes[s] == 0) continue;
+			out.write(zeros, header.offsets[s] - position);
+			out.write(data[s], sizes[s]);
+			position = header.offsets[s] + sizes[s];
+		}
+		if (!out) return false;
+	}
+	std::remove(path.c_str());
+	return std::rename(temporary.c_str(), path.c_str()) == 0;
+}
+
+Map<const MatrixXd> MeshCache::GetVertices() const
+{
+	return Map<const MatrixXd>(Section<double>(SectionV), header.numVertices, 3);
+}
+
+Map<const MeshCache::Faces> MeshCache::GetFaces() const
+{
+	return Map<const Faces>(Section<int>(SectionF), header.numFaces, 3);
+}
+
+Map<const VectorXi> MeshCache::GetRemap() const
+{
+	return Map<const VectorXi>(Section<int>(SectionI), header.numRawVertices);
+}
+
+Map<const MeshCache::Normals> MeshCache::GetNormals() const
+{
+	return Map<const Normals>(Section<float>(SectionN), header.numVertices, 3);
+}
+
+void MeshCache::GetLaplacian(SparseMatrix<double>& L) const
+{
+	const int n = static_cast<int>(header.numVertices);
+	const int nnz = static_cast<int>(header.laplacianNonZeros);
+	// the mapping is read-only, MappedSparseMatrix only wants non-const pointers
+	MappedSparseMatrix<double> mapped(n, n, nnz, const_cast<int*>(Section<int>(SectionLp)),
+		const_cast<int*>(Section<int>(SectionLi)), const_cast<double*>(Section<double>(SectionLx)));
+	L = mapped;
+}
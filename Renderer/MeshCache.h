@@ -0,0 +1,104 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include <Eigen/Core>
+#include <Eigen/SparseCore>
+
+#include "MappedFile.h"
+
+// Binary container of a cleaned mesh and what was precomputed for it, memory mapped
+// on load. The sections are 64 byte aligned and stored the way they are used: V as
+// a column major double matrix, F as row major int triangles and N as row major
+// float normals (ready for GL uploads), I as the raw to cleaned vertex remap and L
+// in compressed sparse column form (the CSR of the symmetric L).
+//
+// A cache is keyed by the content hash of the mesh or volume it was made from and by
+// the weld epsilon or iso value it was cleaned or extracted with. The code behind the
+// cached data is not part of the key, version is bumped whenever what it makes
+// changes. utils.py writes the same format.
+//
+// Layout, little endian:
+//   Header (128 bytes)
+//   V  numVertices*3 doubles
+//   F  numFaces*3 int32
+//   I  numRawVertices int32
+//   N  numVertices*3 floats           if flags & FlagNormals
+//   Lp numVertices+1 int32            if flags & FlagLaplacian
+//   Li laplacianNonZeros int32
+//   Lx laplacianNonZeros doubles
+class MeshCache
+{
+public:
+	enum Flags : uint32_t
+	{
+		FlagNormals = 1,
+		FlagLaplacian = 2,
+	};
+
+	struct Header
+	{
+		char magic[8];  // "VRNMESH" and a zero
+		uint32_t version;
+		uint32_t flags;
+		uint64_t sourceHash;
+		int64_t numVertices;
+		int64_t numFaces;
+		int64_t numRawVertices;
+		int64_t laplacianNonZeros;
+		uint64_t offsets[7];  // of V, F, I, N, Lp, Li, Lx from the start of the file, 0 if absent
+		double weldEpsilon;
+		double iso;
+	};
+
+	// what a cache is made from, parameters that do not apply to the source are 0
+	struct Key
+	{
+		uint64_t sourceHash;
+		double weldEpsilon;  // of the vertices of a mesh
+		double iso;          // of the surface of a volume
+	};
+
+	// 2: the key has the weld and extraction parameters, volumes have no orphan vertices
+	static const uint32_t version = 2;
+
+	using Faces = Eigen::Matrix<int, Eigen::Dynamic, 3, Eigen::RowMajor>;
+	using Normals = Eigen::Matrix<float, Eigen::Dynamic, 3, Eigen::RowMajor>;
+
+	MeshCache();
+	~MeshCache();
+
+	// Hash of the words of the file contents, each word mixed with its position by
+	// splitmix64 and the results summed, so it is computed in parallel here and
+	// vectorized in Python. Returns false if the file can not be read.
+	static bool HashFile(const std::string& path, uint64_t& hash);
+	static uint64_t Hash(const char* data, size_t size);
+
+	// Maps the cache, false if it is missing, of another version, truncated or made
+	// with another key
+	bool Open(const std::string& path, const Key& key);
+	void Close();
+	// N and L are optional
+	static bool Write(const std::string& path, const Key& key, const Eigen::MatrixXd& V, const Eigen::MatrixXi& F,
+		const Eigen::VectorXi& I, const Eigen::MatrixXd* N = nullptr, const Eigen::SparseMatrix<double>* L = nullptr);
+
+	// views into the mapping, valid while the cache is open
+	Eigen::Map<const Eigen::MatrixXd> GetVertices() const;
+	Eigen::Map<const Faces> GetFaces() const;
+	Eigen::Map<const Eigen::VectorXi> GetRemap() const;
+	bool HasNormals() const { return (header.flags & Flags::FlagNormals) != 0; }
+	Eigen::Map<const Normals> GetNormals() const;
+	bool HasLaplacian() const { return (header.flags & Flags::FlagLaplacian) != 0; }
+	// copies, the solvers keep their own matrices anyway
+	void GetLaplacian(Eigen::SparseMatrix<double>& L) const;
+
+private:
+	template <typename T>
+	const T* Section(int section) const { return reinterpret_cast<const T*>(file.GetData() + header.offsets[section]); }
+
+	MappedFile file;
+	Header header;
+};
+
+static_assert(sizeof(MeshCache::Header) == 128, "MeshCache::Header must stay 128 bytes");
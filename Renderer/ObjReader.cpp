@@ -0,0 +1,259 @@
+#include "ObjReader.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+#if defined(__has_include) && __cplusplus >= 201703L
+#if __has_include(<charconv>)
+#include <charconv>
+#endif
+#endif
+
+#include <igl/parallel_for.h>
+
+#include "MappedFile.h"
+#include "Parallel.h"
+
+using namespace Eigen;
+
+namespace {
+
+const size_t chunkSize = 1 << 20;
+
+inline const char* SkipBlanks(const char* p, const char* end)
+{
+	while (p < end && (*p == ' ' || *p == '\t')) p++;
+	return p;
+}
+
+inline const char* SkipToken(const char* p, const char* end)
+{
+	while (p < end && *p != ' ' && *p != '\t' && *p != '\r') p++;
+	return p;
+}
+
+// end of the line starting at p, the newline itself is not part of it
+inline const char* LineEnd(const char* p, const char* end)
+{
+	const char* newline = static_cast<const char*>(memchr(p, '\n', end - p));
+	return newline ? newline : end;
+}
+
+inline bool IsVertexLine(const char* p, const char* end)
+{
+	return end - p >= 2 && p[0] == 'v' && (p[1] == ' ' || p[1] == '\t');
+}
+
+inline bool IsFaceLine(const char* p, const char* end)
+{
+	return end - p >= 2 && p[0] == 'f' && (p[1] == ' ' || p[1] == '\t');
+}
+
+inline bool ParseDouble(const char*& p, const char* end, double& value)
+{
+#if defined(__cpp_lib_to_chars) && __cpp_lib_to_chars >= 201611L
+	if (p < end && *p == '+') p++;
+	const std::from_chars_result result = std::from_chars(p, end, value);
+	if (result.ec != std::errc()) return false;
+	p = result.ptr;
+	return true;
+#else
+	// strtod needs a terminated string, the mapping is not
+	char buffer[64];
+	const size_t length = SkipToken(p, end) - p;
+	if (length == 0 || length >= sizeof(buffer)) return false;
+	memcpy(buffer, p, length);
+	buffer[length] = '\0';
+	char* parsed;
+	value = strtod(buffer, &parsed);
+	if (parsed == buffer) return false;
+	p += parsed - buffer;
+	return true;
+#endif
+}
+
+// index of one face corner, "i", "i/t", "i//n" or "i/t/n", the rest is skipped
+inline bool ParseIndex(const char*& p, const char* end, int& index)
+{
+	bool negative = false;
+	if (p < end && *p == '-')
+	{
+		negative = true;
+		p++;
+	}
+	if (p == end || *p < '0' || *p > '9') return false;
+	int value = 0;
+	while (p < end && *p >= '0' && *p <= '9') value = value * 10 + (*p++ - '0');
+	index = negative ? -value : value;
+	p = SkipToken(p, end);
+	return true;
+}
+
+} // namespace
+
+
+ObjReader::ObjReader()
+{
+}
+
+ObjReader::~ObjReader()
+{
+}
+
+void ObjReader::Split(const char* data, size_t size)
+{
+	chunks.clear();
+	const char* end = data + size;
+	const char* begin = data;
+	while (begin < end)
+	{
+		const char* split = begin + std::min(chunkSize, static_cast<size_t>(end - begin));
+		if (split < end) split = std::min(end, LineEnd(split, end) + 1);
+		chunks.push_back({ begin, split, 0, 0, nullptr });
+		begin = split;
+	}
+}
+
+void ObjReader::Count(Chunk& chunk)
+{
+	int vertices = 0;
+	int triangles = 0;
+	for (const char* line = chunk.begin; line < chunk.end; )
+	{
+		const char* end = LineEnd(line, chunk.end);
+		const char* p = SkipBlanks(line, end);
+		if (IsVertexLine(p, end))
+		{
+			vertices++;
+		}
+		else if (IsFaceLine(p, end))
+		{
+			int corners = 0;
+			for (p = SkipBlanks(p + 1, end); p < end && *p != '\r'; p = SkipBlanks(SkipToken(p, end), end))
+				corners++;
+			if (corners < 3 && !chunk.badLine) chunk.badLine = line;
+			triangles += std::max(0, corners - 2);
+		}
+		line = end + 1;
+	}
+	chunk.vertices = vertices;
+	chunk.triangles = triangles;
+}
+
+void ObjReader::Parse(Chunk& chunk, MatrixXd& V, MatrixXi& F)
+{
+	const int numVertices = V.rows();
+	int v = chunk.vertices;
+	int f = chunk.triangles;
+	for (const char* line = chunk.begin; line < chunk.end && !chunk.badLine; )
+	{
+		const char* end = LineEnd(line, chunk.end);
+		const char* p = SkipBlanks(line, end);
+		if (IsVertexLine(p, end))
+		{
+			// a fourth (weight) coordinate is ignored
+			for (int c = 0; c < 3; c++)
+			{
+				p = SkipBlanks(p + (c == 0), end);
+				if (!ParseDouble(p, end, V(v, c)))
+				{
+					chunk.badLine = line;
+					break;
+				}
+			}
+			v++;
+		}
+		else if (IsFaceLine(p, end))
+		{
+			// fan around the first corner, relative indices count back from the
+			// vertices read so far
+			int first = -1;
+			int previous = -1;
+			for (p = SkipBlanks(p + 1, end); p < end && *p != '\r'; p = SkipBlanks(p, end))
+			{
+				int index;
+				if (!ParseIndex(p, end, index) || index == 0)
+				{
+					chunk.badLine = line;
+					break;
+				}
+				index = index > 0 ? index - 1 : v + index;
+				if (index < 0 || index >= numVertices)
+				{
+					chunk.badLine = line;
+					break;
+				}
+				if (first < 0)
+				{
+					first = index;
+				}
+				else if (previous < 0)
+				{
+					previous = index;
+				}
+				else
+				{
+					F(f, 0) = first;
+					F(f, 1) = previous;
+					F(f, 2) = index;
+					previous = index;
+					f++;
+				}
+			}
+		}
+		line = end + 1;
+	}
+}
+
+bool ObjReader::Read(const std::string& path, MatrixXd& V, MatrixXi& F)
+{
+	V.resize(0, 3);
+	F.resize(0, 3);
+	error.clear();
+
+	MappedFile file;
+	if (!file.Open(path))
+	{
+		error = "can not open " + path;
+		return false;
+	}
+	Split(file.GetData(), file.GetSize());
+	const int numChunks = chunks.size();
+
+	igl::parallel_for(numChunks, [&](int c) {
+		Count(chunks[c]);
+	}, 1);
+
+	std::vector<int> vertexStart(numChunks);
+	std::vector<int> faceStart(numChunks);
+	for (int c = 0; c < numChunks; c++)
+	{
+		vertexStart[c] = chunks[c].vertices;
+		faceStart[c] = chunks[c].triangles;
+	}
+	const int numVertices = Parallel::ExclusiveScan(vertexStart);
+	const int numFaces = Parallel::ExclusiveScan(faceStart);
+	for (int c = 0; c < numChunks; c++)
+	{
+		chunks[c].vertices = vertexStart[c];
+		chunks[c].triangles = faceStart[c];
+	}
+
+	V.resize(numVertices, 3);
+	F.resize(numFaces, 3);
+	igl::parallel_for(numChunks, [&](int c) {
+		if (!chunks[c].badLine) Parse(chunks[c], V, F);
+	}, 1);
+
+	for (const Chunk& chunk : chunks)
+	{
+		if (!chunk.badLine) continue;
+		const char* end = std::min(LineEnd(chunk.badLine, chunk.end), chunk.badLine + 80);
+		error = "malformed line \"" + std::string(chunk.badLine, end) + "\" in " + path;
+		V.resize(0, 3);
+		F.resize(0, 3);
+		return false;
+	}
+	return true;
+}
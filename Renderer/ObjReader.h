@@ -0,0 +1,47 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <Eigen/Core>
+
+// Reader for the geometry of Wavefront OBJ files, made for the large triangle
+// meshes written by marching cubes. The file is memory mapped and split into
+// chunks at line boundaries. One parallel pass counts the vertices and triangles
+// of every chunk, a prefix sum over the counts gives each chunk its first rows,
+// and a second parallel pass parses the chunks straight into V and F.
+//
+// Only "v" and "f" lines are read, texture coordinates, normals, groups and
+// materials are skipped. Polygons are split into triangle fans, negative
+// (relative) indices are resolved.
+class ObjReader
+{
+public:
+	ObjReader();
+	~ObjReader();
+
+	// V: output, vertices
+	// F: output, triangle indices, 0 based
+	// Returns false if the file can not be read, a "v" or "f" line is malformed or
+	// an index is out of range, V and F are then left empty
+	bool Read(const std::string& path, Eigen::MatrixXd& V, Eigen::MatrixXi& F);
+
+	const std::string& GetError() const { return error; }
+
+private:
+	struct Chunk
+	{
+		const char* begin;
+		const char* end;
+		int vertices;         // "v" lines, then the first row of the chunk in V
+		int triangles;        // triangles of the "f" lines, then the first row in F
+		const char* badLine;  // first malformed line, null if none
+	};
+
+	void Split(const char* data, size_t size);
+	static void Count(Chunk& chunk);
+	static void Parse(Chunk& chunk, Eigen::MatrixXd& V, Eigen::MatrixXi& F);
+
+	std::vector<Chunk> chunks;
+	std::string error;
+};
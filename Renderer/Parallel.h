@@ -0,0 +1,41 @@
+#pragma once
+
+#include <algorithm>
+#include <vector>
+
+#include <igl/parallel_for.h>
+
+namespace Parallel {
+
+// In-place exclusive prefix sum, returns the total. Sums chunks in parallel, scans
+// the chunk sums serially and then scans every chunk in parallel from its offset.
+template <typename T>
+T ExclusiveScan(std::vector<T>& values)
+{
+	const int n = static_cast<int>(values.size());
+	const int numChunks = std::max(1, std::min(256, n / 16384));
+	const int chunkSize = (n + numChunks - 1) / numChunks;
+
+	std::vector<T> offsets(numChunks + 1, T(0));
+	igl::parallel_for(numChunks, [&](int c) {
+		T sum = T(0);
+		for (int i = c * chunkSize; i < std::min(n, (c + 1) * chunkSize); i++) sum += values[i];
+		offsets[c + 1] = sum;
+	}, 2);
+
+	for (int c = 0; c < numChunks; c++) offsets[c + 1] += offsets[c];
+
+	igl::parallel_for(numChunks, [&](int c) {
+		T sum = offsets[c];
+		for (int i = c * chunkSize; i < std::min(n, (c + 1) * chunkSize); i++)
+		{
+			T value = values[i];
+			values[i] = sum;
+			sum += value;
+		}
+	}, 2);
+
+	return offsets[numChunks];
+}
+
+} // namespace Parallel
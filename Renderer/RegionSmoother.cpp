@@ -0,0 +1,146 @@
+#include "RegionSmoother.h"
+
+#include <algorithm>
+
+#include <igl/doublearea.h>
+
+using namespace Eigen;
+
+RegionSmoother::RegionSmoother()
+{
+}
+
+RegionSmoother::RegionSmoother(const Options& options)
+	: options(options)
+{
+}
+
+RegionSmoother::~RegionSmoother()
+{
+}
+
+bool RegionSmoother::Analyze(const MatrixXd& V, const MatrixXi& F, const SparseMatrix<double>& L,
+	const std::vector<int>& region)
+{
+	this->region.clear();
+	ring.clear();
+	if (region.empty()) return false;
+
+	// local numbering: the region first, then the vertices of its one-ring outside it
+	const int n = V.rows();
+	std::vector<int> local(n, -1);
+	std::vector<int> unknowns;
+	unknowns.reserve(region.size());
+	for (int v : region)
+	{
+		if (local[v] >= 0) continue;
+		local[v] = unknowns.size();
+		unknowns.push_back(v);
+	}
+	const int r = unknowns.size();
+	for (int v : unknowns)
+	{
+		for (SparseMatrix<double>::InnerIterator it(L, v); it; ++it)
+		{
+			if (local[it.row()] >= 0) continue;
+			local[it.row()] = r + ring.size();
+			ring.push_back(it.row());
+		}
+	}
+	const int m = r + ring.size();
+
+	// lumped barycentric masses of the region and the total area, the step is
+	// normalized to unit area like the one of LaplacianSmoother
+	VectorXd dblA;
+	igl::doublearea(V, F, dblA);
+	const double area = 0.5 * dblA.sum();
+	mass = VectorXd::Zero(r);
+	for (int f = 0; f < F.rows(); f++)
+	{
+		for (int k = 0; k < 3; k++)
+		{
+			const int i = local[F(f, k)];
+			if (i >= 0 && i < r) mass[i] += dblA[f] / 6.0;
+		}
+	}
+
+	// A = M - coeff*area*L on the rows and columns touching the region, the block
+	// between ring vertices is never used by the solve
+	const double scale = -options.coeff * area;
+	std::vector<Triplet<double>> triplets;
+	for (int j = 0; j < r; j++)
+	{
+		triplets.emplace_back(j, j, mass[j]);
+		for (SparseMatrix<double>::InnerIterator it(L, unknowns[j]); it; ++it)
+		{
+			const int i = local[it.row()];
+			triplets.emplace_back(i, j, scale * it.value());
+			if (i >= r) triplets.emplace_back(j, i, scale * it.value());
+		}
+	}
+	SparseMatrix<double> A(m, m);
+	A.setFromTriplets(triplets.begin(), triplets.end());
+
+	VectorXi known(m - r);
+	for (int i = 0; i < m - r; i++) known[i] = r + i;
+	const SparseMatrix<double> Aeq(0, m);
+	if (!igl::min_quad_with_fixed_precompute(A, known, Aeq, true, data))
+	{
+		ring.clear();
+		return false;
+	}
+	this->region = std::move(unknowns);
+	B = MatrixXd::Zero(m, 3);
+	Y.resize(m - r, 3);
+	return true;
+}
+
+void RegionSmoother::Smooth(MatrixXd& U, int iterations)
+{
+	// nothing to do for an empty region or a failed Analyze
+	if (!IsAnalyzed()) return;
+
+	const int r = region.size();
+	for (int i = 0; i < int(ring.size()); i++)
+		Y.row(i) = U.row(ring[i]);
+	const MatrixXd Beq(0, 3);
+	for (int k = 0; k < iterations; k++)
+	{
+		// minimizes 0.5 Z'AZ - Z'MU with the ring fixed, i.e. solves A Z = M U
+		for (int i = 0; i < r; i++)
+			B.row(i) = -mass[i] * U.row(region[i]);
+		igl::min_quad_with_fixed_solve(data, B, Y, Beq, Z);
+		for (int i = 0; i < r; i++)
+			U.row(region[i]) = Z.row(i);
+	}
+}
+
+std::vector<int> RegionSmoother::GrowRegion(const SparseMatrix<double>& L, const std::vector<int>& seeds, int rings)
+{
+	std::vector<bool> inside(L.cols(), false);
+	std::vector<int> region;
+	for (int v : seeds)
+	{
+		if (inside[v]) continue;
+		inside[v] = true;
+		region.push_back(v);
+	}
+
+	// breadth first, the vertices added by the previous ring are the front
+	size_t front = 0;
+	for (int k = 0; k < rings; k++)
+	{
+		const size_t end = region.size();
+		for (; front < end; front++)
+		{
+			for (SparseMatrix<double>::InnerIterator it(L, region[front]); it; ++it)
+			{
+				if (inside[it.row()]) continue;
+				inside[it.row()] = true;
+				region.push_back(it.row());
+			}
+		}
+	}
+	std::sort(region.begin(), region.end());
+	return region;
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <vector>
+
+#include <Eigen/Core>
+#include <Eigen/SparseCore>
+#include <igl/min_quad_with_fixed.h>
+
+// Implicit smoothing of a region of interest, the rest of the mesh stays where it
+// is. Only the region and the one-ring around it enter the system: the ring is the
+// fixed boundary of igl::min_quad_with_fixed, the region its unknowns. The reduced
+// system (M - coeff*area*L) is factorized once in Analyze with the masses of the
+// input mesh, which in original coordinates is the normalized step of
+// LaplacianSmoother, so a step costs a solve of the size of the region.
+class RegionSmoother
+{
+public:
+	struct Options
+	{
+		double coeff = 0.00002;
+	};
+
+	RegionSmoother();
+	explicit RegionSmoother(const Options& options);
+	~RegionSmoother();
+
+	// V: vertices the masses are taken from
+	// F: indices
+	// L: precomputed Laplace-Beltrami operator of the mesh
+	// region: indices of the vertices to smooth
+	// Returns false if the region is empty or the factorization failed
+	bool Analyze(const Eigen::MatrixXd& V, const Eigen::MatrixXi& F, const Eigen::SparseMatrix<double>& L,
+		const std::vector<int>& region);
+	// U: vertices input & output, only the rows of the region change, unchanged if
+	// Analyze failed
+	void Smooth(Eigen::MatrixXd& U, int iterations = 1);
+
+	// region grown from seeds by rings one-rings along the pattern of L
+	static std::vector<int> GrowRegion(const Eigen::SparseMatrix<double>& L, const std::vector<int>& seeds, int rings);
+
+	bool IsAnalyzed() const { return !region.empty(); }
+	const Options& GetOptions() const { return options; }
+	const std::vector<int>& GetRegion() const { return region; }
+
+private:
+	Options options;
+	std::vector<int> region;  // global indices of the unknowns, local 0..r-1
+	std::vector<int> ring;    // global indices of the fixed one-ring, local r..
+	Eigen::VectorXd mass;     // lumped masses of the region
+	igl::min_quad_with_fixed_data<double> data;
+	Eigen::MatrixXd B;        // workspaces of every step
+	Eigen::MatrixXd Y;
+	Eigen::MatrixXd Z;
+};
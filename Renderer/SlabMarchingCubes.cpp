@@ -0,0 +1,410 @@
+#include "SlabMarchingCubes.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+#include <igl/parallel_for.h>
+// the tables only, they have internal linkage here
+#include <igl/copyleft/marching_cubes_tables.h>
+
+#include "Parallel.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SLAB_MARCHING_CUBES_USE_SSE2
+#include <emmintrin.h>
+#endif
+
+using namespace Eigen;
+
+namespace {
+
+// corners of a cube as (x, y, z) offsets, numbered like the tables
+const int cornerOffsets[8][3] = {
+	{ 0, 0, 0 }, { 1, 0, 0 }, { 1, 1, 0 }, { 0, 1, 0 },
+	{ 0, 0, 1 }, { 1, 0, 1 }, { 1, 1, 1 }, { 0, 1, 1 },
+};
+
+// edges of a cube: the corners at the lower and the upper end and the axis
+struct CubeEdge
+{
+	int lower;
+	int upper;
+	int axis;
+};
+
+const CubeEdge cubeEdges[12] = {
+	{ 0, 1, 0 }, { 1, 2, 1 }, { 3, 2, 0 }, { 0, 3, 1 },
+	{ 4, 5, 0 }, { 5, 6, 1 }, { 7, 6, 0 }, { 4, 7, 1 },
+	{ 0, 4, 2 }, { 1, 5, 2 }, { 2, 6, 2 }, { 3, 7, 2 },
+};
+
+// vertices a sample owns in a slice table: the one at the sample and the ones
+// inside its +x, +y and +z edges
+enum Slot { SlotPoint, SlotX, SlotY, SlotZ, NumSlots };
+
+// per sample 0xFF or 0, the grid layout without the strides
+struct Masks
+{
+	int nx;
+	int ny;
+	int nz;
+	std::vector<uint8_t> outside;  // below iso
+	std::vector<uint8_t> atIso;
+
+	int64_t Index(int x, int y, int z) const { return (static_cast<int64_t>(z) * ny + y) * nx + x; }
+
+	// at iso and an end of a crossing edge
+	bool IsPointVertex(int x, int y, int z) const
+	{
+		const int64_t i = Index(x, y, z);
+		const int64_t layer = static_cast<int64_t>(nx) * ny;
+		return atIso[i]
+			&& ((x > 0 && outside[i - 1]) || (x + 1 < nx && outside[i + 1])
+				|| (y > 0 && outside[i - nx]) || (y + 1 < ny && outside[i + nx])
+				|| (z > 0 && outside[i - layer]) || (z + 1 < nz && outside[i + layer]));
+	}
+};
+
+// integers are below iso if they are below its ceiling, and at it only if it is one
+void ClassifyRow(const uint8_t* row, int n, double iso, uint8_t* outside, uint8_t* atIso)
+{
+	const double ceiling = std::ceil(iso);
+	if (ceiling > 255)
+	{
+		memset(outside, 0xFF, n);
+		memset(atIso, 0, n);
+		return;
+	}
+	const int below = static_cast<int>(std::max(0.0, ceiling));
+	const int at = ceiling == iso && iso >= 0 ? static_cast<int>(iso) : -1;
+
+	int x = 0;
+#ifdef SLAB_MARCHING_CUBES_USE_SSE2
+	const __m128i belowMask = _mm_set1_epi8(static_cast<char>(below));
+	const __m128i atMask = _mm_set1_epi8(static_cast<char>(at));
+	const __m128i atEnabled = _mm_set1_epi8(at < 0 ? 0 : -1);
+	for (; x + 16 <= n; x += 16)
+	{
+		const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + x));
+		// unsigned v < below is max(v, below) != v
+		const __m128i notBelow = _mm_cmpeq_epi8(_mm_max_epu8(v, belowMask), v);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(outside + x), _mm_andnot_si128(notBelow, _mm_set1_epi8(-1)));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(atIso + x), _mm_and_si128(_mm_cmpeq_epi8(v, atMask), atEnabled));
+	}
+#endif
+	for (; x < n; x++)
+	{
+		outside[x] = row[x] < below ? 0xFF : 0;
+		atIso[x] = row[x] == at ? 0xFF : 0;
+	}
+}
+
+void ClassifyRow(const float* row, int n, double iso, uint8_t* outside, uint8_t* atIso)
+{
+	const float level = static_cast<float>(iso);
+
+	int x = 0;
+#ifdef SLAB_MARCHING_CUBES_USE_SSE2
+	const __m128 levels = _mm_set1_ps(level);
+	for (; x + 16 <= n; x += 16)
+	{
+		__m128i below[4];
+		__m128i at[4];
+		for (int k = 0; k < 4; k++)
+		{
+			const __m128 v = _mm_loadu_ps(row + x + 4 * k);
+			below[k] = _mm_castps_si128(_mm_cmplt_ps(v, levels));
+			at[k] = _mm_castps_si128(_mm_cmpeq_ps(v, levels));
+		}
+		// the lanes are all ones or zeros, saturating packs keep them that way
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(outside + x),
+			_mm_packs_epi16(_mm_packs_epi32(below[0], below[1]), _mm_packs_epi32(below[2], below[3])));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(atIso + x),
+			_mm_packs_epi16(_mm_packs_epi32(at[0], at[1]), _mm_packs_epi32(at[2], at[3])));
+	}
+#endif
+	for (; x < n; x++)
+	{
+		outside[x] = row[x] < level ? 0xFF : 0;
+		atIso[x] = row[x] == level ? 0xFF : 0;
+	}
+}
+
+// Cases of the n cubes of a row from the outside masks of its four sample rows,
+// (y, z), (y + 1, z), (y, z + 1) and (y + 1, z + 1). False if the surface does not
+// pass through the row.
+bool CubeCases(const uint8_t* o00, const uint8_t* o10, const uint8_t* o01, const uint8_t* o11, int n, uint8_t* cases)
+{
+	int x = 0;
+	bool crossed = false;
+#ifdef SLAB_MARCHING_CUBES_USE_SSE2
+	__m128i trivial = _mm_set1_epi8(-1);
+	const auto load = [](const uint8_t* p) { return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p)); };
+	const auto bit = [](__m128i mask, int b) { return _mm_and_si128(mask, _mm_set1_epi8(static_cast<char>(b))); };
+	for (; x + 16 <= n; x += 16)
+	{
+		const __m128i c = _mm_or_si128(
+			_mm_or_si128(_mm_or_si128(bit(load(o00 + x), 1), bit(load(o00 + x + 1), 2)),
+				_mm_or_si128(bit(load(o10 + x + 1), 4), bit(load(o10 + x), 8))),
+			_mm_or_si128(_mm_or_si128(bit(load(o01 + x), 16), bit(load(o01 + x + 1), 32)),
+				_mm_or_si128(bit(load(o11 + x + 1), 64), bit(load(o11 + x), 128))));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(cases + x), c);
+		trivial = _mm_and_si128(trivial, _mm_or_si128(_mm_cmpeq_epi8(c, _mm_setzero_si128()), _mm_cmpeq_epi8(c, _mm_set1_epi8(-1))));
+	}
+	crossed = _mm_movemask_epi8(trivial) != 0xFFFF;
+#endif
+	for (; x < n; x++)
+	{
+		cases[x] = (o00[x] & 1) | (o00[x + 1] & 2) | (o10[x + 1] & 4) | (o10[x] & 8)
+			| (o01[x] & 16) | (o01[x + 1] & 32) | (o11[x + 1] & 64) | (o11[x] & 128);
+		crossed |= cases[x] != 0 && cases[x] != 255;
+	}
+	return crossed;
+}
+
+// Calls visit(x, y, slot) for every vertex owned by the samples of layer z, in the
+// order they are numbered in
+template <typename Visit>
+void ForEachVertex(const Masks& m, int z, const Visit& visit)
+{
+	const int64_t layer = static_cast<int64_t>(m.nx) * m.ny;
+	for (int y = 0; y < m.ny; y++)
+	{
+		const int64_t row = m.Index(0, y, z);
+		const uint8_t* o = &m.outside[row];
+		const uint8_t* e = &m.atIso[row];
+		// next rows, the row itself at the border of the grid, where it never crosses
+		const int64_t dy = y + 1 < m.ny ? m.nx : 0;
+		const int64_t dz = z + 1 < m.nz ? layer : 0;
+
+		const auto sample = [&](int x) {
+			if (e[x] && m.IsPointVertex(x, y, z)) visit(x, y, SlotPoint);
+			if (x + 1 < m.nx && (o[x] ^ o[x + 1]) && !(e[x] | e[x + 1])) visit(x, y, SlotX);
+			if (dy && (o[x] ^ o[x + dy]) && !(e[x] | e[x + dy])) visit(x, y, SlotY);
+			if (dz && (o[x] ^ o[x + dz]) && !(e[x] | e[x + dz])) visit(x, y, SlotZ);
+		};
+
+		int x = 0;
+#ifdef SLAB_MARCHING_CUBES_USE_SSE2
+		// most of a grid is far from the surface, skip 16 samples at once where no
+		// edge crosses and no sample is at iso
+		for (; x + 16 < m.nx; x += 16)
+		{
+			const __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(o + x));
+			const __m128i any = _mm_or_si128(
+				_mm_or_si128(_mm_xor_si128(c, _mm_loadu_si128(reinterpret_cast<const __m128i*>(o + x + 1))),
+					_mm_xor_si128(c, _mm_loadu_si128(reinterpret_cast<const __m128i*>(o + x + dy)))),
+				_mm_or_si128(_mm_xor_si128(c, _mm_loadu_si128(reinterpret_cast<const __m128i*>(o + x + dz))),
+					_mm_loadu_si128(reinterpret_cast<const __m128i*>(e + x))));
+			if (_mm_movemask_epi8(any) == 0) continue;
+			for (int i = x; i < x + 16; i++) sample(i);
+		}
+#endif
+		for (; x < m.nx; x++) sample(x);
+	}
+}
+
+} // namespace
+
+
+SlabMarchingCubes::SlabMarchingCubes()
+{
+}
+
+SlabMarchingCubes::SlabMarchingCubes(const Options& options)
+	: options(options)
+{
+}
+
+SlabMarchingCubes::~SlabMarchingCubes()
+{
+}
+
+void SlabMarchingCubes::Extract(const uint8_t* values, int nx, int ny, int nz, int64_t rowStride, int64_t layerStride,
+	double iso, MatrixXd& V, MatrixXi& F) const
+{
+	Run(values, nx, ny, nz, rowStride, layerStride, iso, V, F);
+}
+
+void SlabMarchingCubes::Extract(const float* values, int nx, int ny, int nz, int64_t rowStride, int64_t layerStride,
+	double iso, MatrixXd& V, MatrixXi& F) const
+{
+	// compared in float, interpolated against the same level
+	Run(values, nx, ny, nz, rowStride, layerStride, static_cast<double>(static_cast<float>(iso)), V, F);
+}
+
+template <typename T>
+void SlabMarchingCubes::Run(const T* values, int nx, int ny, int nz, int64_t rowStride, int64_t layerStride, double iso,
+	MatrixXd& V, MatrixXi& F) const
+{
+	V.resize(0, 3);
+	F.resize(0, 3);
+	if (nx < 2 || ny < 2 || nz < 2) return;
+
+	Masks m;
+	m.nx = nx;
+	m.ny = ny;
+	m.nz = nz;
+	m.outside.resize(static_cast<size_t>(nx) * ny * nz);
+	m.atIso.resize(m.outside.size());
+	igl::parallel_for(nz, [&](int z) {
+		for (int y = 0; y < ny; y++)
+		{
+			const int64_t i = m.Index(0, y, z);
+			ClassifyRow(values + z * layerStride + y * rowStride, nx, iso, &m.outside[i], &m.atIso[i]);
+		}
+	}, 4);
+
+	// first vertex of every layer
+	std::vector<int> layerStart(nz, 0);
+	igl::parallel_for(nz, [&](int z) {
+		int count = 0;
+		ForEachVertex(m, z, [&](int, int, int) { count++; });
+		layerStart[z] = count;
+	}, 4);
+	const int numVertices = Parallel::ExclusiveScan(layerStart);
+	V.resize(numVertices, 3);
+	const auto layerVertices = [&](int z) { return (z + 1 < nz ? layerStart[z + 1] : numVertices) - layerStart[z]; };
+
+	const auto position = [&](int x, int y, int z, int slot, int i) {
+		double p[3] = { static_cast<double>(x), static_cast<double>(y), static_cast<double>(z) };
+		if (slot != SlotPoint)
+		{
+			const int64_t offsets[3] = { 1, rowStride, layerStride };
+			const T* sample = values + z * layerStride + y * rowStride + x;
+			const double s0 = std::abs(sample[0] - iso);
+			const double s1 = std::abs(sample[offsets[slot - SlotX]] - iso);
+			p[slot - SlotX] += s0 / (s0 + s1);
+		}
+		V(i, 0) = p[0];
+		V(i, 1) = p[1];
+		V(i, 2) = p[2];
+	};
+
+	// slab s triangulates the cubes between sample layers [z0, z1] and makes the
+	// vertices of layers [z0, z1), the last one those of the last layer as well
+	const int numCubeLayers = nz - 1;
+	const int slabDepth = std::max(1, options.slabDepth);
+	const int numSlabs = (numCubeLayers + slabDepth - 1) / slabDepth;
+	std::vector<std::vector<int>> slabFaces(numSlabs);
+	igl::parallel_for(numSlabs, [&](int s) {
+		const int z0 = s * slabDepth;
+		const int z1 = std::min(numCubeLayers, z0 + slabDepth);
+		// only the slots of vertices are ever read, the tables are not initialized
+		std::unique_ptr<int[]> tables[2];
+		tables[0].reset(new int[static_cast<size_t>(nx) * ny * NumSlots]);
+		tables[1].reset(new int[static_cast<size_t>(nx) * ny * NumSlots]);
+
+		const auto number = [&](int z, int* table) {
+			if (layerVertices(z) == 0) return;
+			const bool owned = z < z1 || z == nz - 1;
+			int index = layerStart[z];
+			ForEachVertex(m, z, [&](int x, int y, int slot) {
+				table[(static_cast<size_t>(y) * nx + x) * NumSlots + slot] = index;
+				if (owned) position(x, y, z, slot, index);
+				index++;
+			});
+		};
+
+		std::vector<int>& faces = slabFaces[s];
+		std::vector<uint8_t> cases(nx - 1);
+		number(z0, tables[0].get());
+		for (int z = z0; z < z1; z++)
+		{
+			const int* lower = tables[(z - z0) & 1].get();
+			int* upper = tables[(z - z0 + 1) & 1].get();
+			number(z + 1, upper);
+			// the edges of the cubes are those of the two layers, none crosses
+			if (layerVertices(z) == 0 && layerVertices(z + 1) == 0) continue;
+
+			const int64_t layer = static_cast<int64_t>(nx) * ny;
+			const auto vertex = [&](int x, int y, int corner, int slot) {
+				const int* offset = cornerOffsets[corner];
+				const int* table = offset[2] ? upper : lower;
+				return table[(static_cast<size_t>(y + offset[1]) * nx + x + offset[0]) * NumSlots + slot];
+			};
+			const auto isAtIso = [&](int64_t i, int corner) {
+				const int* offset = cornerOffsets[corner];
+				return m.atIso[i + offset[2] * layer + offset[1] * nx + offset[0]] != 0;
+			};
+
+			for (int y = 0; y + 1 < ny; y++)
+			{
+				const int64_t row = m.Index(0, y, z);
+				const uint8_t* o = &m.outside[row];
+				if (!CubeCases(o, o + nx, o + layer, o + layer + nx, nx - 1, cases.data())) continue;
+
+				for (int x = 0; x + 1 < nx; x++)
+				{
+					const int c = cases[x];
+					if (c == 0 || c == 255) continue;
+
+					int samples[12];
+					for (int e = 0; e < 12; e++)
+					{
+						if (!(edgeTable[c] & (1 << e))) continue;
+						const CubeEdge& edge = cubeEdges[e];
+						// a crossing edge with an end at iso collapsed into that end,
+						// which is the one not outside
+						if (isAtIso(row + x, edge.lower) || isAtIso(row + x, edge.upper))
+							samples[e] = vertex(x, y, c & (1 << edge.lower) ? edge.upper : edge.lower, SlotPoint);
+						else
+							samples[e] = vertex(x, y, edge.lower, SlotX + edge.axis);
+					}
+					for (int t = 0; triTable[c][0][t] != -1; t += 3)
+					{
+						const int a = samples[triTable[c][0][t]];
+						const int b = samples[triTable[c][0][t + 1]];
+						const int d = samples[triTable[c][0][t + 2]];
+						if (a == b || b == d || a == d) continue;
+						faces.push_back(a);
+						faces.push_back(b);
+						faces.push_back(d);
+					}
+				}
+			}
+		}
+	}, 1);
+
+	// stitch the triangles of the slabs together
+	std::vector<int> slabStart(numSlabs);
+	for (int s = 0; s < numSlabs; s++) slabStart[s] = static_cast<int>(slabFaces[s].size() / 3);
+	const int numFaces = Parallel::ExclusiveScan(slabStart);
+	F.resize(numFaces, 3);
+	igl::parallel_for(numSlabs, [&](int s) {
+		const std::vector<int>& faces = slabFaces[s];
+		for (size_t f = 0; f < faces.size() / 3; f++)
+		{
+			F.row(slabStart[s] + f) << faces[3 * f], faces[3 * f + 1], faces[3 * f + 2];
+		}
+	}, 1);
+
+	RemoveUnreferenced(V, F);
+}
+
+void SlabMarchingCubes::RemoveUnreferenced(MatrixXd& V, MatrixXi& F)
+{
+	const int n = static_cast<int>(V.rows());
+	std::vector<int> remap(n, 0);
+	for (int f = 0; f < F.rows(); f++)
+	{
+		remap[F(f, 0)] = 1;
+		remap[F(f, 1)] = 1;
+		remap[F(f, 2)] = 1;
+	}
+	const int numReferenced = Parallel::ExclusiveScan(remap);
+	if (numReferenced == n) return;
+
+	// a vertex is referenced if the scan steps past it
+	MatrixXd referenced(numReferenced, 3);
+	igl::parallel_for(n, [&](int i) {
+		if ((i + 1 < n ? remap[i + 1] : numReferenced) != remap[i]) referenced.row(remap[i]) = V.row(i);
+	}, 10000);
+	igl::parallel_for(static_cast<int>(F.rows()), [&](int f) {
+		for (int k = 0; k < 3; k++) F(f, k) = remap[F(f, k)];
+	}, 10000);
+	V.swap(referenced);
+}
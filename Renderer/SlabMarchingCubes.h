@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstdint>
+
+#include <Eigen/Core>
+
+// Marching cubes over a dense grid of samples, x fastest, then y, then z, with the
+// tables of igl::copyleft::marching_cubes, but every vertex is made exactly once and
+// the mesh comes out indexed. The case bits are set for the samples below iso, so
+// the triangles are those igl makes from iso - value. From value - iso it makes the
+// same vertices, but it indexes the complementary cases, whose ambiguous faces the
+// tables split the other way: the triangles of those cubes, and their count, differ.
+//
+// The grid is classified into outside (below iso) and at-iso masks first, 16
+// samples per SSE2 instruction. The vertices are then counted per layer and an
+// exclusive scan gives every layer the index of its first vertex, so slabs of
+// layers are triangulated in parallel without any hashing: a slab numbers the
+// vertices of its layers and of the first layer of the next slab into two slice
+// tables, and the cubes in between read their edge vertices from there.
+//
+// A vertex belongs to the lower end of its edge. Samples exactly at iso make the
+// vertices of their crossing edges coincide, those collapse into one vertex at the
+// sample, and triangles left degenerate by that are dropped, as well as the vertices
+// only such triangles referenced.
+class SlabMarchingCubes
+{
+public:
+	struct Options
+	{
+		int slabDepth = 8;  // layers of cubes per task
+	};
+
+	SlabMarchingCubes();
+	explicit SlabMarchingCubes(const Options& options);
+	~SlabMarchingCubes();
+
+	// values: first sample, the samples of a row are contiguous, rows are rowStride
+	//         and layers layerStride samples apart
+	// nx, ny, nz: samples along x, y and z, at least 2 each
+	// V: output, vertices in grid coordinates (x, y, z)
+	// F: output, triangles wound so that the normals point to the samples below iso
+	void Extract(const uint8_t* values, int nx, int ny, int nz, int64_t rowStride, int64_t layerStride, double iso,
+		Eigen::MatrixXd& V, Eigen::MatrixXi& F) const;
+	void Extract(const float* values, int nx, int ny, int nz, int64_t rowStride, int64_t layerStride, double iso,
+		Eigen::MatrixXd& V, Eigen::MatrixXi& F) const;
+
+	const Options& GetOptions() const { return options; }
+
+private:
+	template <typename T>
+	void Run(const T* values, int nx, int ny, int nz, int64_t rowStride, int64_t layerStride, double iso,
+		Eigen::MatrixXd& V, Eigen::MatrixXi& F) const;
+
+	// Drops the vertices no triangle references, the others keep their order. A
+	// sample at iso is numbered before its triangles are made, and all of them can
+	// collapse, e.g. at a lone sample at iso among samples below it.
+	static void RemoveUnreferenced(Eigen::MatrixXd& V, Eigen::MatrixXi& F);
+
+	Options options;
+};
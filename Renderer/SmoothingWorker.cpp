@@ -0,0 +1,152 @@
+#include "SmoothingWorker.h"
+
+#include <iostream>
+#include <vector>
+
+#include <igl/per_vertex_normals.h>
+
+using namespace Eigen;
+
+SmoothingWorker::SmoothingWorker(LaplacianSmoother& implicitSmoother, TaubinSmoother& explicitSmoother, RegionSmoother& regionSmoother,
+	SpectralSmoother& spectralSmoother,
+	const MatrixXd& V, const MatrixXd& U, const MatrixXi& F, const SparseMatrix<double>& L)
+	: implicitSmoother(implicitSmoother)
+	, explicitSmoother(explicitSmoother)
+	, regionSmoother(regionSmoother)
+	, spectralSmoother(spectralSmoother)
+	, V(V)
+	, F(F)
+	, L(L)
+	, U(U)
+	, stopping(false)
+	, cancelCount(0)
+	, back(&buffers[0])
+	, published(nullptr)
+	, spare(&buffers[1])
+{
+	thread = std::thread(&SmoothingWorker::Loop, this);
+}
+
+SmoothingWorker::~SmoothingWorker()
+{
+	stopping = true;
+	Cancel();
+	thread.join();
+}
+
+bool SmoothingWorker::Post(const Request& request)
+{
+	if (!requests.Push({ request, cancelCount.load() })) return false;
+	// an empty critical section orders the push before a sleeping worker's check
+	{
+		std::lock_guard<std::mutex> lock(wakeMutex);
+	}
+	wake.notify_one();
+	return true;
+}
+
+void SmoothingWorker::Cancel()
+{
+	cancelCount++;
+	{
+		std::lock_guard<std::mutex> lock(wakeMutex);
+	}
+	wake.notify_one();
+}
+
+bool SmoothingWorker::Fetch(MatrixXf& U, MatrixXf& N)
+{
+	Buffer* front = published.exchange(nullptr);
+	if (!front) return false;
+	U.swap(front->U);
+	N.swap(front->N);
+	spare.store(front);
+	return true;
+}
+
+void SmoothingWorker::Publish()
+{
+	// the normals are computed from the rounded vertices, in float as well
+	back->U = U.cast<float>();
+	igl::per_vertex_normals(back->U, F, back->N);
+
+	// the previous result was not fetched yet, overwrite it next time
+	Buffer* old = published.exchange(back);
+	if (old)
+	{
+		back = old;
+		return;
+	}
+	// otherwise the render thread holds the other buffer at most for two swaps
+	while (!(back = spare.exchange(nullptr))) std::this_thread::yield();
+}
+
+void SmoothingWorker::Loop()
+{
+	std::vector<QueuedRequest> batch;
+	while (!stopping)
+	{
+		{
+			std::unique_lock<std::mutex> lock(wakeMutex);
+			wake.wait(lock, [&] { return stopping || !requests.Empty(); });
+		}
+		if (stopping) break;
+
+		// coalesce everything queued so far, a reset drops the requests before it,
+		// requests posted before a cancel are dropped, later cancels abort the batch
+		batch.clear();
+		QueuedRequest queued;
+		while (requests.Pop(queued))
+		{
+			const Request& request = queued.request;
+			if (queued.generation < cancelCount.load())
+				continue;
+			if (request.type == RequestType::Reset)
+				batch.clear();
+			// requests on both sides of a cancel stay apart, the earlier one is aborted
+			const bool merge = !batch.empty() && batch.back().request.type == request.type
+				&& batch.back().generation == queued.generation;
+			if (merge && request.type == RequestType::Spectral)
+				batch.back() = queued;
+			else if (merge)
+				batch.back().request.iterations += request.iterations;
+			else
+				batch.push_back(queued);
+		}
+
+		for (const QueuedRequest& entry : batch)
+		{
+			const Request& r = entry.request;
+			if (r.type == RequestType::Reset)
+			{
+				U = V;
+				continue;
+			}
+			if (r.type == RequestType::Spectral)
+			{
+				if (!spectralSmoother.IsAnalyzed())
+				{
+					std::cout << "Computing the Laplacian eigenbasis..." << std::endl;
+					spectralSmoother.Analyze(V, F, L, [&] { return cancelCount.load() != entry.generation || stopping; });
+					if (!spectralSmoother.IsAnalyzed())
+					{
+						std::cout << "Laplacian eigenbasis cancelled" << std::endl;
+						continue;
+					}
+				}
+				spectralSmoother.Filter(r.amount, U);
+				continue;
+			}
+			for (int i = 0; i < r.iterations && cancelCount.load() == entry.generation && !stopping; i++)
+			{
+				if (r.type == RequestType::Implicit)
+					implicitSmoother.Smooth(U);
+				else if (r.type == RequestType::Region)
+					regionSmoother.Smooth(U);
+				else
+					explicitSmoother.Smooth(U);
+			}
+		}
+		if (!stopping && !batch.empty()) Publish();
+	}
+}
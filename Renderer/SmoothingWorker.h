@@ -0,0 +1,98 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include <Eigen/Core>
+#include <Eigen/SparseCore>
+
+#include "LaplacianSmoother.h"
+#include "RegionSmoother.h"
+#include "SpectralSmoother.h"
+#include "SpscQueue.h"
+#include "TaubinSmoother.h"
+
+// Runs the smoothing on a background thread so the render loop never waits for a
+// solve. The render thread posts requests through a lock-free queue, the worker
+// merges consecutive requests of the same kind into one batch, smooths its own copy
+// of the vertices and publishes vertices and normals into one of two buffers. Fetch
+// picks up the latest published buffer without blocking; GL uploads stay on the
+// render thread.
+class SmoothingWorker
+{
+public:
+	enum class RequestType
+	{
+		Implicit,  // LaplacianSmoother steps
+		Explicit,  // TaubinSmoother iterations
+		Region,    // RegionSmoother steps, the rest of the mesh stays
+		Spectral,  // replaces U by the original vertices filtered by SpectralSmoother, only the last one counts
+		Reset,     // back to the original vertices, drops everything queued before
+	};
+
+	struct Request
+	{
+		RequestType type;
+		int iterations;
+		double amount;  // Spectral only
+	};
+
+	// the smoothers must be analyzed, they are only used by the worker from now on;
+	// the spectral one is analyzed on the first spectral request, Cancel abandons that
+	// V: original vertices, U: current vertices
+	SmoothingWorker(LaplacianSmoother& implicitSmoother, TaubinSmoother& explicitSmoother, RegionSmoother& regionSmoother,
+		SpectralSmoother& spectralSmoother,
+		const Eigen::MatrixXd& V, const Eigen::MatrixXd& U, const Eigen::MatrixXi& F, const Eigen::SparseMatrix<double>& L);
+	~SmoothingWorker();
+
+	// render thread only, returns false if the queue is full
+	bool Post(const Request& request);
+	// drops the queued requests and abandons the running batch after its current
+	// iteration, publishing what was done so far
+	void Cancel();
+	// render thread only, swaps the latest result into U and N, false if none is new;
+	// results are single precision, all the renderer needs
+	bool Fetch(Eigen::MatrixXf& U, Eigen::MatrixXf& N);
+
+private:
+	struct QueuedRequest
+	{
+		Request request;
+		unsigned generation;  // cancelCount when posted
+	};
+
+	struct Buffer
+	{
+		Eigen::MatrixXf U;
+		Eigen::MatrixXf N;
+	};
+
+	void Loop();
+	void Publish();
+
+	LaplacianSmoother& implicitSmoother;
+	TaubinSmoother& explicitSmoother;
+	RegionSmoother& regionSmoother;
+	SpectralSmoother& spectralSmoother;
+	const Eigen::MatrixXd V;
+	const Eigen::MatrixXi F;
+	const Eigen::SparseMatrix<double> L;
+	Eigen::MatrixXd U;  // worker's state
+
+	SpscQueue<QueuedRequest, 64> requests;
+	std::mutex wakeMutex;  // only to sleep while the queue is empty
+	std::condition_variable wake;
+	std::atomic<bool> stopping;
+	std::atomic<unsigned> cancelCount;
+
+	// one buffer is filled by the worker, the other one is either published, read
+	// by Fetch or spare
+	Buffer buffers[2];
+	Buffer* back;
+	std::atomic<Buffer*> published;
+	std::atomic<Buffer*> spare;
+
+	std::thread thread;
+};
@@ -0,0 +1,146 @@
+#include "SpectralSmoother.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <random>
+
+#include <Eigen/Cholesky>
+#include <Eigen/Eigenvalues>
+#include <Eigen/SparseCholesky>
+#include <igl/parallel_for.h>
+
+using namespace Eigen;
+
+namespace {
+
+// Y = Y R^-1 with R^T R = Y^T M Y, twice for accuracy (CholeskyQR2)
+void OrthonormalizeM(MatrixXd& Y, const VectorXd& mass)
+{
+	for (int pass = 0; pass < 2; pass++)
+	{
+		MatrixXd G = Y.transpose() * mass.asDiagonal() * Y;
+		// tiny regularization against numerically dependent columns
+		G.diagonal().array() += 1e-14 * G.diagonal().maxCoeff();
+		LLT<MatrixXd> llt(G);
+		Y = llt.matrixU().solve<OnTheRight>(Y);
+	}
+}
+
+} // namespace
+
+
+SpectralSmoother::SpectralSmoother() : scale(1.0)
+{
+}
+
+SpectralSmoother::SpectralSmoother(const Options& options) : options(options), scale(1.0)
+{
+}
+
+SpectralSmoother::~SpectralSmoother()
+{
+}
+
+bool SpectralSmoother::Analyze(const MatrixXd& V, const MatrixXi& F, const SparseMatrix<double>& L,
+	const CancelCheck& isCancelled)
+{
+	const int n = V.rows();
+	const int k = std::min(options.numModes, n);
+	// oversampling, the convergence rate of mode i is lambda_i / lambda_p
+	const int p = std::min(n, k + std::max(8, k / 2));
+
+	// centred, unit area mesh and its masses, as in LaplacianSmoother
+	CotanAssembler assembler;
+	assembler.Analyze(F, n);
+	VectorXd dblA;
+	VectorXd mass;
+	const double area = assembler.ComputeMass(V, dblA, mass, centroid);
+	scale = std::sqrt(area);
+	const MatrixXd Vn = (V.rowwise() - centroid) / scale;
+
+	// -L is only semi-definite, shift by sigma*M; the scale of the spectrum is
+	// mesh independent after normalization
+	const double sigma = 1e-2;
+	const SparseMatrix<double> K = -L;
+	SparseMatrix<double> M;
+	assembler.AssembleMass(dblA, M, 1.0 / area);
+	const SparseMatrix<double> A = K + sigma * M;
+	SimplicialLDLT<SparseMatrix<double>> solver(A);
+	if (solver.info() != Success)
+	{
+		std::cerr << "SpectralSmoother: factorization failed" << std::endl;
+		return false;
+	}
+
+	// start from a fixed random block, deterministic results
+	std::mt19937 generator(5489u);
+	std::uniform_real_distribution<double> distribution(-1.0, 1.0);
+	MatrixXd X(n, p);
+	for (int j = 0; j < p; j++)
+		for (int i = 0; i < n; i++) X(i, j) = distribution(generator);
+	OrthonormalizeM(X, mass);
+
+	bool converged = false;
+	MatrixXd Y(n, p);
+	VectorXd theta;
+	for (int iteration = 0; iteration < options.maxIterations && !converged; iteration++)
+	{
+		// the basis is only set at the end, so the smoother stays unanalyzed
+		if (isCancelled && isCancelled()) return false;
+
+		// shift-invert, back-substitute the columns concurrently
+		const MatrixXd B = mass.asDiagonal() * X;
+		igl::parallel_for(p, [&](int j) {
+			Y.col(j) = solver.solve(B.col(j));
+		}, 1);
+		OrthonormalizeM(Y, mass);
+
+		// Rayleigh-Ritz on the M-orthonormal block
+		const MatrixXd KY = K * Y;
+		MatrixXd H = Y.transpose() * KY;
+		H = 0.5 * (H + H.transpose()).eval();
+		SelfAdjointEigenSolver<MatrixXd> eigen(H);
+		theta = eigen.eigenvalues();
+		X.noalias() = Y * eigen.eigenvectors();
+
+		// residuals of the wanted pairs, K x - theta M x
+		const MatrixXd KX = KY * eigen.eigenvectors();
+		double worst = 0;
+		for (int j = 0; j < k; j++)
+		{
+			const double r = (KX.col(j) - theta[j] * mass.cwiseProduct(X.col(j))).norm();
+			const double norm = (std::abs(theta[j]) + sigma) * mass.cwiseProduct(X.col(j)).norm();
+			worst = std::max(worst, r / norm);
+		}
+		converged = worst < options.tolerance;
+	}
+	if (!converged)
+		std::cerr << "SpectralSmoother: eigenpairs did not converge in " << options.maxIterations << " iterations" << std::endl;
+
+	basis = X.leftCols(k);
+	eigenvalues = theta.head(k);
+	coefficients = basis.transpose() * mass.asDiagonal() * Vn;
+	residual = Vn - basis * coefficients;
+	const MatrixXd KR = K * residual;
+	for (int c = 0; c < 3; c++)
+	{
+		const double energy = residual.col(c).dot(mass.cwiseProduct(residual.col(c)));
+		// the residual is M-orthogonal to the basis, its frequency is above lambda_k
+		residualEigenvalues[c] = energy > 0 ? std::max(eigenvalues[k - 1], residual.col(c).dot(KR.col(c)) / energy) : eigenvalues[k - 1];
+	}
+	return converged;
+}
+
+void SpectralSmoother::Filter(double amount, MatrixXd& U) const
+{
+	const int k = static_cast<int>(eigenvalues.size());
+	VectorXd gains(k);
+	for (int j = 0; j < k; j++)
+		gains[j] = std::pow(1.0 + options.coeff * std::max(0.0, eigenvalues[j]), -amount);
+
+	U.noalias() = basis * (gains.asDiagonal() * coefficients);
+	for (int c = 0; c < 3; c++)
+		U.col(c) += std::pow(1.0 + options.coeff * residualEigenvalues[c], -amount) * residual.col(c);
+	U = (U * scale).rowwise() + centroid;
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <functional>
+
+#include <Eigen/Core>
+#include <Eigen/SparseCore>
+
+#include "CotanAssembler.h"
+
+// Smoothing as a filter on the low frequencies of the mesh. Analyze computes the k
+// smallest eigenpairs of -L phi = lambda M phi on the centred, unit area mesh, with
+// shift-invert block subspace iteration and Rayleigh-Ritz projection, i.e. one
+// factorization and a few dozen block back-substitutions. Filter then damps every
+// eigen coefficient by (1 + coeff*lambda)^-amount, what amount implicit steps of
+// LaplacianSmoother do to that mode with the mesh frozen. The part of the mesh
+// outside the basis (the fine detail and the noise) is damped as a single mode,
+// with its Rayleigh quotient as frequency. amount is continuous and every call
+// costs O(n*k).
+class SpectralSmoother
+{
+public:
+	struct Options
+	{
+		int numModes = 64;         // k
+		double coeff = 0.00002;    // time step of one implicit step
+		double tolerance = 1e-3;   // relative eigen residual, plenty for filtering
+		int maxIterations = 30;
+	};
+
+	// polled between the subspace iterations, true abandons Analyze
+	using CancelCheck = std::function<bool()>;
+
+	SpectralSmoother();
+	explicit SpectralSmoother(const Options& options);
+	~SpectralSmoother();
+
+	// V: vertices, the filtered signal
+	// F: indices
+	// L: precomputed Laplace-Beltrami operator of the mesh
+	// returns false if the eigenpairs did not converge, the basis is usable anyway;
+	// also false if isCancelled returned true, the smoother stays unanalyzed then
+	bool Analyze(const Eigen::MatrixXd& V, const Eigen::MatrixXi& F, const Eigen::SparseMatrix<double>& L,
+		const CancelCheck& isCancelled = nullptr);
+	// U: output, V smoothed by amount >= 0 implicit steps
+	void Filter(double amount, Eigen::MatrixXd& U) const;
+
+	bool IsAnalyzed() const { return basis.cols() > 0; }
+	const Eigen::VectorXd& GetEigenvalues() const { return eigenvalues; }
+	const Options& GetOptions() const { return options; }
+
+private:
+	Options options;
+	Eigen::MatrixXd basis;         // n by k, M-orthonormal eigenvectors
+	Eigen::VectorXd eigenvalues;   // ascending
+	Eigen::MatrixXd coefficients;  // k by 3, basis^T M V of the normalized V
+	Eigen::MatrixXd residual;      // n by 3, normalized V minus its projection
+	Eigen::RowVector3d residualEigenvalues;  // Rayleigh quotients of the residual columns
+	Eigen::RowVector3d centroid;
+	double scale;
+};
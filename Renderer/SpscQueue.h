@@ -0,0 +1,42 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+
+// Bounded lock-free queue for exactly one producer and one consumer thread. Head
+// and tail only ever grow, the slots are addressed modulo Capacity.
+template <typename T, unsigned Capacity>
+class SpscQueue
+{
+	static_assert((Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+	T items[Capacity];
+	std::atomic<unsigned> head;  // next slot to pop, written by the consumer
+	char padding[64];            // keep head and tail on different cache lines
+	std::atomic<unsigned> tail;  // next slot to push, written by the producer
+
+public:
+	SpscQueue() : head(0), tail(0) {}
+
+	// producer only, returns false if the queue is full
+	bool Push(const T& item)
+	{
+		const unsigned t = tail.load(std::memory_order_relaxed);
+		if (t - head.load(std::memory_order_acquire) == Capacity) return false;
+		items[t & (Capacity - 1)] = item;
+		tail.store(t + 1, std::memory_order_release);
+		return true;
+	}
+
+	// consumer only, returns false if the queue is empty
+	bool Pop(T& item)
+	{
+		const unsigned h = head.load(std::memory_order_relaxed);
+		if (h == tail.load(std::memory_order_acquire)) return false;
+		item = items[h & (Capacity - 1)];
+		head.store(h + 1, std::memory_order_release);
+		return true;
+	}
+
+	bool Empty() const { return head.load(std::memory_order_acquire) == tail.load(std::memory_order_acquire); }
+};
@@ -0,0 +1,97 @@
+#include "TaubinSmoother.h"
+#include "CotanAssembler.h"
+
+#include <cassert>
+#include <utility>
+
+#include <Eigen/SparseCore>
+#include <igl/parallel_for.h>
+
+using namespace Eigen;
+
+TaubinSmoother::TaubinSmoother()
+{
+}
+
+TaubinSmoother::TaubinSmoother(const Options& options) : options(options)
+{
+}
+
+TaubinSmoother::~TaubinSmoother()
+{
+}
+
+void TaubinSmoother::Analyze(const MatrixXd& V, const MatrixXi& F)
+{
+	// the pattern of the cotangent Laplacian is the one-ring adjacency, L is
+	// symmetric, so its columns are the rows
+	CotanAssembler assembler;
+	assembler.Analyze(F, V.rows());
+	SparseMatrix<double> L;
+	assembler.AssembleLaplacian(V, L);
+
+	const int n = V.rows();
+	rowStart.resize(n + 1);
+	neighbours.resize(L.nonZeros() - n);
+	weights.resize(L.nonZeros() - n);
+	const int* outer = L.outerIndexPtr();
+	igl::parallel_for(n + 1, [&](int i) {
+		// one diagonal entry per column before i
+		rowStart[i] = outer[i] - i;
+	}, 10000);
+
+	const int* inner = L.innerIndexPtr();
+	const double* values = L.valuePtr();
+	igl::parallel_for(n, [&](int i) {
+		const int valence = outer[i + 1] - outer[i] - 1;
+		double diagonal = 0;
+		for (int s = outer[i]; s < outer[i + 1]; s++)
+			if (inner[s] == i) diagonal = values[s];
+
+		int k = rowStart[i];
+		for (int s = outer[i]; s < outer[i + 1]; s++)
+		{
+			if (inner[s] == i) continue;
+			neighbours[k] = inner[s];
+			if (options.weights == Weights::Cotangent && diagonal != 0)
+				weights[k] = values[s] / -diagonal;
+			else
+				weights[k] = 1.0 / valence;
+			k++;
+		}
+	}, 1000);
+}
+
+void TaubinSmoother::Step(const Positions& from, Positions& to, double factor) const
+{
+	const int n = static_cast<int>(from.size());
+	igl::parallel_for(n, [&](int i) {
+		Array4d average = Array4d::Zero();
+		for (int k = rowStart[i]; k < rowStart[i + 1]; k++)
+			average += weights[k] * from[neighbours[k]];
+		// isolated vertices stay where they are
+		if (rowStart[i] == rowStart[i + 1]) average = from[i];
+		to[i] = from[i] + factor * (average - from[i]);
+	}, 1000);
+}
+
+void TaubinSmoother::Smooth(MatrixXd& U, int iterations)
+{
+	assert(IsAnalyzed() && "Analyze must be called before Smooth");
+	const int n = U.rows();
+	current.resize(n);
+	next.resize(n);
+	igl::parallel_for(n, [&](int i) {
+		current[i] << U(i, 0), U(i, 1), U(i, 2), 0.0;
+	}, 10000);
+
+	for (int k = 0; k < iterations; k++)
+	{
+		Step(current, next, options.lambda);
+		Step(next, current, options.mu);
+	}
+
+	igl::parallel_for(n, [&](int i) {
+		U.row(i) = current[i].head<3>().matrix().transpose();
+	}, 10000);
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <vector>
+
+#include <Eigen/Core>
+#include <Eigen/StdVector>
+
+// Explicit lambda/mu smoothing (Taubin 95): a shrinking step U += lambda*(W U - U)
+// followed by an inflating step with mu < -lambda, which damps high frequencies
+// without the shrinkage of plain Laplacian smoothing. W is a row normalized
+// uniform or cotangent weighting of the one-ring, stored as a compressed row
+// adjacency, and applied without building a matrix. Positions are padded to
+// 4 doubles, so x, y and z of a neighbour are gathered and summed together.
+class TaubinSmoother
+{
+public:
+	enum class Weights
+	{
+		Uniform,    // 1/valence, smooths the sampling as well
+		Cotangent,  // cotangent weights of the input mesh, keeps the sampling
+	};
+
+	struct Options
+	{
+		double lambda = 0.5;
+		double mu = -0.53;
+		Weights weights = Weights::Cotangent;
+	};
+
+	TaubinSmoother();
+	explicit TaubinSmoother(const Options& options);
+	~TaubinSmoother();
+
+	// V: vertices the cotangent weights are taken from
+	// F: indices
+	void Analyze(const Eigen::MatrixXd& V, const Eigen::MatrixXi& F);
+	// U: vertices input & output, every iteration is one lambda and one mu step
+	void Smooth(Eigen::MatrixXd& U, int iterations = 1);
+
+	bool IsAnalyzed() const { return !rowStart.empty(); }
+	const Options& GetOptions() const { return options; }
+
+private:
+	using Positions = std::vector<Eigen::Array4d, Eigen::aligned_allocator<Eigen::Array4d>>;
+
+	void Step(const Positions& from, Positions& to, double factor) const;
+
+	Options options;
+	std::vector<int> rowStart;  // one-ring of vertex i is [rowStart[i], rowStart[i + 1])
+	std::vector<int> neighbours;
+	std::vector<double> weights;
+	Positions current;
+	Positions next;
+};
@@ -1,10 +1,14 @@
 #include "Utilities.h"
+#include "BVH4.h"
 #include "BVHTree.h"
+#include "CotanAssembler.h"
+#include "DisjointSet.h"
+#include "HashGrid.h"
+#include "Parallel.h"
 
 #include <iostream>
 
 #include <igl/barycenter.h>
-#include <igl/cotmatrix.h>
 #include <igl/doublearea.h>
 #include <igl/grad.h>
 
@@ -21,7 +25,9 @@ namespace Utilities {
 void Laplacian::Precompute(const MatrixXd& V, const MatrixXi & F, SparseMatrix<double>& L, SparseMatrix<double>* K)
 {
 	// Compute Laplace-Beltrami operator: #V by #V
-	igl::cotmatrix(V, F, L);
+	CotanAssembler assembler;
+	assembler.Analyze(F, V.rows());
+	assembler.AssembleLaplacian(V, L);
 
 	// Alternative construction of same Laplacian
 	SparseMatrix<double> G;
@@ -41,119 +47,134 @@ void Laplacian::Precompute(const MatrixXd& V, const MatrixXi & F, SparseMatrix<d
 	}
 }
 
-void Laplacian::Smooth(Eigen::MatrixXd& U, const Eigen::MatrixXi& F, const Eigen::SparseMatrix<double>& L)
+void Laplacian::Smooth(Eigen::MatrixXd& U, const Eigen::MatrixXi& F, const Eigen::SparseMatrix<double>& L,
+	const LaplacianSmoother::Options& options)
 {
-	const double coeff = 0.00002;
-
-	// Compute centroid and subtract (also important for numerics)
-	VectorXd dblA;
-	igl::doublearea(U, F, dblA);
-	double area = 0.5*dblA.sum();
-	MatrixXd BC;
-	igl::barycenter(U, F, BC);
-	RowVector3d centroid(0, 0, 0);
-	for (int i = 0; i<BC.rows(); i++)
-	{
-		centroid += 0.5*dblA(i) / area * BC.row(i);
-	}
-	U.rowwise() -= centroid;
-	// Normalize to unit surface area (important for numerics)
-	U.array() /= sqrt(area);
-
-
-	// Recompute just mass matrix on each step
-	SparseMatrix<double> M;
-	igl::massmatrix(U, F, igl::MASSMATRIX_TYPE_BARYCENTRIC, M);
-	// Solve (M-delta*L) U = M*U
-	const auto & S = (M - coeff*L);
-	Eigen::SimplicialLLT<Eigen::SparseMatrix<double> > solver(S);
-	assert(solver.info() == Eigen::Success);
-	U = solver.solve(M*U).eval();
-
-
-	// restore the original dimension
-	U.array() *= sqrt(area);
-	U.rowwise() += centroid;
+	LaplacianSmoother smoother(options);
+	smoother.Analyze(F, L);
+	smoother.Smooth(U);
+}
 
+void Laplacian::Smooth(Eigen::MatrixXd& U, const Eigen::MatrixXi& F, const Eigen::SparseMatrix<double>& L, int iterations,
+	const LaplacianSmoother::Options& options)
+{
+	LaplacianSmoother smoother(options);
+	smoother.Analyze(F, L);
+	smoother.Smooth(U, iterations);
 }
 
 
-void Clean::RemoveDuplicates(const MatrixXd & V, const MatrixXi & F, MatrixXd & NV, MatrixXi & NF, Eigen::VectorXi & I, const double epsilon)
+void Clean::RemoveDuplicates(const MatrixXd & V, const MatrixXi & F, MatrixXd & NV, MatrixXi & NF, Eigen::VectorXi & I, const double epsilon,
+	WeldMethod method)
 {
 	using namespace std;
 	//// build collapse map
 	int n = V.rows();
 
 	I = VectorXi(n);
-	I[0] = 0;
-
-	BVHTree tree;
-	tree.Build(V, F, epsilon);
-
-	CandidateIndexPairs canditatePairs;
-	tree.BroadPhaseDetect(canditatePairs);
-	//std::cout << canditatePairs.size() << std::endl;
 
-	std::vector<int> indicesMapping;
-	indicesMapping.reserve(n);
-	for (int i = 0; i < n; i++) indicesMapping.push_back(i);
-
-	for (const auto& p : canditatePairs)
+	// merge the vertices as soon as the broad phase reports them, the visitor is
+	// called from several threads
+	ConcurrentDisjointSet sets(n);
+	auto merge = [&](int idx1, int idx2)
 	{
-		int idx1 = p.first;
-		int idx2 = p.second;
-
 		if ((V.row(idx1) - V.row(idx2)).norm() < epsilon)
-		{
-			int newIdx = idx1;
-			while (indicesMapping[newIdx] != newIdx)
-				newIdx = indicesMapping[newIdx]; // trace back to root indices
-			indicesMapping[idx2] = newIdx;
-		}
+			sets.Union(idx1, idx2);
+	};
 
+	if (method == WeldMethod::HashGrid)
+	{
+		HashGrid grid;
+		grid.Build(V, epsilon);
+		grid.BroadPhaseDetect(merge);
 	}
-
-	bool *VISITED = new bool[n];
-	for (int i = 0; i <n; ++i)
-		VISITED[i] = false;
-
-	NV.resize(n, V.cols());
-	int count = 0;
-	for (int i = 0; i <n; ++i)
+	else if (method == WeldMethod::BVH4)
 	{
-		if (indicesMapping[i] == i)
-		{
-			NV.row(count) = V.row(i);
-			I[i] = count;
-			count++;
-		}
-		else
-		{
-			I[i] = I[indicesMapping[i]];
-		}
+		BVH4 tree;
+		tree.Build(V, epsilon);
+		tree.BroadPhaseDetect(merge);
+	}
+	else
+	{
+		BVHTree tree;
+		tree.Build(V, F, epsilon);
+		tree.BroadPhaseDetect(merge);
 	}
 
-	NV.conservativeResize(count, Eigen::NoChange);
-
-	count = 0;
-	std::vector<int> face;
-	NF.resizeLike(F);
-	for (int i = 0; i <F.rows(); ++i)
+	// every set is represented by its smallest vertex, which keeps its position in
+	// the order of the kept vertices, a prefix sum over the roots numbers them
+	std::vector<int> roots(n);
+	std::vector<int> newIndices(n);
+	igl::parallel_for(n, [&](int i) {
+		roots[i] = sets.Find(i);
+		newIndices[i] = (roots[i] == i) ? 1 : 0;
+	}, 10000);
+	int count = Parallel::ExclusiveScan(newIndices);
+
+	NV.resize(count, V.cols());
+	igl::parallel_for(n, [&](int i) {
+		I[i] = newIndices[roots[i]];
+		if (roots[i] == i) NV.row(I[i]) = V.row(i);
+	}, 10000);
+
+	//// remap faces, dropping the ones with collapsed corners
+	const int numFaces = F.rows();
+	if (F.cols() != 3)
 	{
-		face.clear();
-		for (int j = 0; j< F.cols(); ++j)
-			if (std::find(face.begin(), face.end(), I[F(i, j)]) == face.end())
-				face.push_back(I[F(i, j)]);
-		if (face.size() == size_t(F.cols()))
+		count = 0;
+		std::vector<int> face;
+		NF.resizeLike(F);
+		for (int i = 0; i < numFaces; ++i)
 		{
-			for (unsigned j = 0; j< F.cols(); ++j)
-				NF(count, j) = face[j];
-			count++;
+			face.clear();
+			for (int j = 0; j < F.cols(); ++j)
+				if (std::find(face.begin(), face.end(), I[F(i, j)]) == face.end())
+					face.push_back(I[F(i, j)]);
+			if (face.size() == size_t(F.cols()))
+			{
+				for (int j = 0; j < F.cols(); ++j)
+					NF(count, j) = face[j];
+				count++;
+			}
 		}
+		NF.conservativeResize(count, Eigen::NoChange);
+		return;
 	}
-	NF.conservativeResize(count, Eigen::NoChange);
 
-	delete[] VISITED;
+	// triangles: remap and test the corners chunk by chunk without branches, count
+	// the kept faces per chunk and scatter them to their offsets in a second pass
+	const int chunkSize = 16384;
+	const int numChunks = (numFaces + chunkSize - 1) / chunkSize;
+	std::vector<int> kept(numFaces);
+	std::vector<int> offsets(numChunks);
+	igl::parallel_for(numChunks, [&](int c) {
+		const int end = std::min(numFaces, (c + 1) * chunkSize);
+		int sum = 0;
+		for (int i = c * chunkSize; i < end; i++)
+		{
+			const int a = I[F(i, 0)];
+			const int b = I[F(i, 1)];
+			const int d = I[F(i, 2)];
+			kept[i] = (a != b) & (b != d) & (a != d);
+			sum += kept[i];
+		}
+		offsets[c] = sum;
+	}, 2);
+	count = Parallel::ExclusiveScan(offsets);
+
+	NF.resize(count, 3);
+	igl::parallel_for(numChunks, [&](int c) {
+		const int end = std::min(numFaces, (c + 1) * chunkSize);
+		int out = offsets[c];
+		for (int i = c * chunkSize; i < end; i++)
+		{
+			if (!kept[i]) continue;
+			NF(out, 0) = I[F(i, 0)];
+			NF(out, 1) = I[F(i, 1)];
+			NF(out, 2) = I[F(i, 2)];
+			out++;
+		}
+	}, 2);
 }
 
 } // namespace Utilities
@@ -3,6 +3,8 @@
 #include <Eigen/Core>
 #include <Eigen/SparseCore>
 
+#include "LaplacianSmoother.h"
+
 namespace Utilities {
 
 using Eigen::MatrixXd;
@@ -20,14 +22,29 @@ void Precompute(const MatrixXd& V, const MatrixXi& F, SparseMatrix<double>& L, S
 // U: vertices input & output, output the smoothed input vertices
 // F: indices
 // L: precomputed Laplace-Beltrami operator
-void Smooth(MatrixXd& U, const MatrixXi& F, const SparseMatrix<double>& L);
+// options: solver of the linear system, Cholesky or warm-started CG
+// analyzes the system from scratch, use a LaplacianSmoother to smooth repeatedly
+void Smooth(MatrixXd& U, const MatrixXi& F, const SparseMatrix<double>& L,
+	const LaplacianSmoother::Options& options = LaplacianSmoother::Options());
+// iterations steps in one call, see LaplacianSmoother::Options::lagSteps
+void Smooth(MatrixXd& U, const MatrixXi& F, const SparseMatrix<double>& L, int iterations,
+	const LaplacianSmoother::Options& options = LaplacianSmoother::Options());
 
 } // namespace Laplacian
 
 
 namespace Clean {
 
-void RemoveDuplicates(const MatrixXd &V, const MatrixXi &F, MatrixXd &NV, MatrixXi &NF, Eigen::VectorXi &I, const double epsilon = 2.2204e-15);
+// broad phase used to find the vertices to weld
+enum class WeldMethod
+{
+	BVH,       // bounding volume hierarchy over epsilon boxes
+	BVH4,      // the same hierarchy collapsed to 4-wide nodes with SIMD overlap tests
+	HashGrid,  // hashed uniform grid with cell size epsilon, expected O(n)
+};
+
+void RemoveDuplicates(const MatrixXd &V, const MatrixXi &F, MatrixXd &NV, MatrixXi &NF, Eigen::VectorXi &I, const double epsilon = 2.2204e-15,
+	WeldMethod method = WeldMethod::HashGrid);
 
 } // namespace Clean
 
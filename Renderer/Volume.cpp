@@ -0,0 +1,172 @@
+#include "Volume.h"
+
+#include <cstdio>
+#include <cstring>
+
+#include "SlabMarchingCubes.h"
+
+using namespace Eigen;
+
+namespace {
+
+bool EndsWith(const std::string& s, const std::string& suffix)
+{
+	return s.size() >= suffix.size() && s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+// value of key in the header dictionary of a .npy file, up to the next ',' or '}'
+// outside of parentheses
+std::string NpyValue(const std::string& header, const std::string& key)
+{
+	size_t p = header.find("'" + key + "'");
+	if (p == std::string::npos) return "";
+	p = header.find(':', p);
+	if (p == std::string::npos) return "";
+	int depth = 0;
+	size_t end = ++p;
+	for (; end < header.size(); end++)
+	{
+		const char c = header[end];
+		if (c == '(') depth++;
+		if (c == ')') depth--;
+		if (depth == 0 && (c == ',' || c == '}')) break;
+	}
+	std::string value = header.substr(p, end - p);
+	value.erase(0, value.find_first_not_of(" '\""));
+	value.erase(value.find_last_not_of(" '\"") + 1);
+	return value;
+}
+
+} // namespace
+
+
+Volume::Volume()
+	: voxels(nullptr), type(Type::UInt8), depth(0), height(0), width(0)
+{
+}
+
+Volume::~Volume()
+{
+}
+
+bool Volume::IsVolumePath(const std::string& path)
+{
+	return EndsWith(path, ".npy") || EndsWith(path, ".raw");
+}
+
+bool Volume::ParseNpyHeader(size_t& dataOffset)
+{
+	const char* data = file.GetData();
+	const size_t size = file.GetSize();
+	if (size < 10 || memcmp(data, "\x93NUMPY", 6) != 0)
+	{
+		error = "not a .npy file";
+		return false;
+	}
+	// version 1 has a 16-bit header length, versions 2 and 3 a 32-bit one
+	size_t headerLength;
+	size_t headerStart;
+	if (data[6] == 1)
+	{
+		headerLength = static_cast<uint8_t>(data[8]) | static_cast<uint8_t>(data[9]) << 8;
+		headerStart = 10;
+	}
+	else
+	{
+		if (size < 12)
+		{
+			error = "truncated .npy header";
+			return false;
+		}
+		headerLength = 0;
+		for (int i = 3; i >= 0; i--) headerLength = headerLength << 8 | static_cast<uint8_t>(data[8 + i]);
+		headerStart = 12;
+	}
+	if (headerStart + headerLength > size)
+	{
+		error = "truncated .npy header";
+		return false;
+	}
+	const std::string header(data + headerStart, headerLength);
+	dataOffset = headerStart + headerLength;
+
+	const std::string descr = NpyValue(header, "descr");
+	if (descr == "|u1" || descr == "<u1" || descr == "u1" || descr == "|b1")
+		type = Type::UInt8;
+	else if (descr == "<f4")
+		type = Type::Float32;
+	else
+	{
+		error = "unsupported .npy type " + descr + ", expected uint8 or little endian float32";
+		return false;
+	}
+	if (NpyValue(header, "fortran_order") != "False")
+	{
+		error = "Fortran ordered .npy volumes are not supported";
+		return false;
+	}
+	int dims[3];
+	if (sscanf(NpyValue(header, "shape").c_str(), "(%d , %d , %d )", &dims[0], &dims[1], &dims[2]) != 3)
+	{
+		error = "expected a 3 dimensional .npy array";
+		return false;
+	}
+	depth = dims[0];
+	height = dims[1];
+	width = dims[2];
+	return true;
+}
+
+bool Volume::Open(const std::string& path, int depth, int height, int width)
+{
+	voxels = nullptr;
+	error.clear();
+	if (!file.Open(path))
+	{
+		error = "can not open " + path;
+		return false;
+	}
+
+	size_t offset = 0;
+	if (EndsWith(path, ".npy"))
+	{
+		if (!ParseNpyHeader(offset)) return false;
+	}
+	else
+	{
+		type = Type::UInt8;
+		this->depth = depth;
+		this->height = height;
+		this->width = width;
+	}
+
+	const size_t count = static_cast<size_t>(this->depth) * this->height * this->width;
+	const size_t bytes = count * (type == Type::UInt8 ? 1 : sizeof(float));
+	if (this->depth < 2 || this->height < 2 || this->width < 2 || offset + bytes > file.GetSize())
+	{
+		error = "volume " + path + " is smaller than its dimensions";
+		return false;
+	}
+	voxels = file.GetData() + offset;
+	return true;
+}
+
+void Volume::ExtractSurface(double iso, MatrixXd& V, MatrixXi& F, double zScale) const
+{
+	const SlabMarchingCubes marchingCubes;
+	const int64_t layerStride = static_cast<int64_t>(height) * width;
+	MatrixXi MF;
+	if (type == Type::UInt8)
+		marchingCubes.Extract(static_cast<const uint8_t*>(voxels), width, height, depth, width, layerStride, iso, V, MF);
+	else
+		marchingCubes.Extract(static_cast<const float*>(voxels), width, height, depth, width, layerStride, iso, V, MF);
+
+	// The triangles are wound so that the normals point out of the surface. In the
+	// OBJ of im2obj.py they point in, PyMCubes works on (d, y, x) and the swap of the
+	// axes mirrors its mesh; FaceModel relies on that, swap two corners
+	F.resize(MF.rows(), 3);
+	F.col(0) = MF.col(0);
+	F.col(1) = MF.col(2);
+	F.col(2) = MF.col(1);
+	V.col(2) *= zScale;
+}
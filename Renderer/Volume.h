@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include <Eigen/Core>
+
+#include "MappedFile.h"
+
+// Memory mapped occupancy volume as written by VRN, indexed (d, y, x) with x the
+// fastest. Reads NumPy .npy files (C order, uint8 or float32) and headerless raw
+// uint8 files of known dimensions.
+//
+// ExtractSurface runs SlabMarchingCubes on it with the axes of im2obj.py: a vertex at
+// voxel coordinates (d, y, x) ends up at (x, y, d*zScale), and the triangles are
+// wound like the ones of PyMCubes. The vertices are those of the exported OBJ, but
+// cubes with ambiguous faces can be triangulated differently, so the triangles are
+// not guaranteed to be the same.
+class Volume
+{
+public:
+	enum class Type
+	{
+		UInt8,
+		Float32,
+	};
+
+	Volume();
+	~Volume();
+
+	// depth, height, width: dimensions of raw files, .npy files carry their own
+	bool Open(const std::string& path, int depth = 200, int height = 192, int width = 192);
+	// .npy and .raw are volumes, everything else is taken for a mesh
+	static bool IsVolumePath(const std::string& path);
+
+	float operator()(int d, int y, int x) const
+	{
+		const int64_t i = (static_cast<int64_t>(d) * height + y) * width + x;
+		return type == Type::UInt8 ? static_cast<const uint8_t*>(voxels)[i] : static_cast<const float*>(voxels)[i];
+	}
+
+	// V: output, vertices
+	// F: output, triangles, every vertex is made once, so no cleaning is needed
+	void ExtractSurface(double iso, Eigen::MatrixXd& V, Eigen::MatrixXi& F, double zScale = 0.5) const;
+
+	int GetDepth() const { return depth; }
+	int GetHeight() const { return height; }
+	int GetWidth() const { return width; }
+	Type GetType() const { return type; }
+	const std::string& GetError() const { return error; }
+
+private:
+	bool ParseNpyHeader(size_t& dataOffset);
+
+	MappedFile file;
+	const void* voxels;
+	Type type;
+	int depth;
+	int height;
+	int width;
+	std::string error;
+};
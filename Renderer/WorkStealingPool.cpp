@@ -0,0 +1,79 @@
+#include "WorkStealingPool.h"
+
+#include <algorithm>
+#include <thread>
+
+WorkStealingPool::WorkStealingPool(int numThreads)
+	: numThreads(numThreads > 0 ? numThreads : std::max(1, static_cast<int>(std::thread::hardware_concurrency())))
+	, pending(0)
+{
+	for (int t = 0; t < this->numThreads; t++) workers.emplace_back(new Worker());
+}
+
+WorkStealingPool::~WorkStealingPool()
+{
+}
+
+void WorkStealingPool::Run(Task root)
+{
+	Spawn(0, std::move(root));
+
+	std::vector<std::thread> threads;
+	for (int t = 1; t < numThreads; t++) threads.emplace_back(&WorkStealingPool::WorkerLoop, this, t);
+	WorkerLoop(0);
+	for (auto& t : threads) t.join();
+}
+
+void WorkStealingPool::Spawn(int thread, Task task)
+{
+	pending++;
+	Worker& w = *workers[thread];
+	std::lock_guard<std::mutex> lock(w.mutex);
+	w.tasks.push_back(std::move(task));
+}
+
+bool WorkStealingPool::PopOrSteal(int thread, Task& task)
+{
+	{
+		Worker& w = *workers[thread];
+		std::lock_guard<std::mutex> lock(w.mutex);
+		if (!w.tasks.empty())
+		{
+			task = std::move(w.tasks.back());
+			w.tasks.pop_back();
+			return true;
+		}
+	}
+	for (int k = 1; k < numThreads; k++)
+	{
+		Worker& victim = *workers[(thread + k) % numThreads];
+		std::lock_guard<std::mutex> lock(victim.mutex);
+		if (!victim.tasks.empty())
+		{
+			task = std::move(victim.tasks.front());
+			victim.tasks.pop_front();
+			return true;
+		}
+	}
+	return false;
+}
+
+void WorkStealingPool::WorkerLoop(int thread)
+{
+	// a task is only counted as done after it has spawned its children, so
+	// pending reaching zero means there is nothing left anywhere
+	Task task;
+	while (pending > 0)
+	{
+		if (PopOrSteal(thread, task))
+		{
+			task(thread);
+			task = nullptr;
+			pending--;
+		}
+		else
+		{
+			std::this_thread::yield();
+		}
+	}
+}
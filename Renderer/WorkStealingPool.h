@@ -0,0 +1,43 @@
+#pragma once
+
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// Fork-join pool for recursive work. Every worker owns a deque, pushes and pops its
+// own tasks at the back (depth first, cache friendly) and, once it runs dry, steals
+// from the front of the other deques, where the largest pending tasks are.
+class WorkStealingPool
+{
+public:
+	// thread: index of the worker running the task, in [0, GetNumThreads())
+	using Task = std::function<void(int thread)>;
+
+	// numThreads = 0 uses one worker per hardware thread
+	explicit WorkStealingPool(int numThreads = 0);
+	~WorkStealingPool();
+
+	int GetNumThreads() const { return numThreads; }
+
+	// Runs root and every task spawned from it, returns once all of them finished.
+	void Run(Task root);
+	// Queues a task on the deque of the calling worker, only valid inside Run.
+	void Spawn(int thread, Task task);
+
+private:
+	struct Worker
+	{
+		std::mutex mutex;
+		std::deque<Task> tasks;
+	};
+
+	int numThreads;
+	std::vector<std::unique_ptr<Worker>> workers;
+	std::atomic<int> pending;
+
+	void WorkerLoop(int thread);
+	bool PopOrSteal(int thread, Task& task);
+};
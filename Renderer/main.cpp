@@ -4,6 +4,7 @@
 #define _USE_MATH_DEFINES
 #include <cmath>
 
+#include <algorithm>
 #include <iostream>
 #include <vector>
 #include <memory>
@@ -14,15 +15,23 @@
 #include <GLFW/glfw3.h>
 #include <Eigen/Core>
 #include <Eigen/SparseCore>
-#include <igl/readOBJ.h>
 #include <igl/remove_duplicates.h>
 #include <igl/per_vertex_normals.h>
+#include <igl/is_border_vertex.h>
 
 
 #include "FaceModel.h"
+#include "LaplacianSmoother.h"
+#include "MeshCache.h"
+#include "ObjReader.h"
+#include "RegionSmoother.h"
 #include "DirectionalLightSphere.h"
 #include "ShaderProgram.h"
+#include "SmoothingWorker.h"
+#include "SpectralSmoother.h"
+#include "TaubinSmoother.h"
 #include "Utilities.h"
+#include "Volume.h"
 
 using namespace Eigen;
 using namespace std;
@@ -33,16 +42,40 @@ MatrixXi rawF; // raw indices
 
 // after mesh cleaning
 MatrixXd V; // original vertices
+// U and N are startup only, the worker smooths its own copy of U and publishes
+// g_displayU and g_displayN, these two are not updated after the first fetch
 MatrixXd U; // updated vertices
 MatrixXd N; // per-vertice normals
+MatrixXf g_displayU; // single precision vertices and normals published by the worker
+MatrixXf g_displayN;
 MatrixXi F; // face indices
 SparseMatrix<double> L; // Laplace-Beltrami operator 
 SparseMatrix<double> K; 
+// exact steps in double by default; several steps per factorization
+// (Options::lagSteps > 1) and a float factor (Precision::Single or Mixed) change
+// the result slightly and are opt-in
+static LaplacianSmoother::Options SmootherOptions()
+{
+	LaplacianSmoother::Options options;
+	options.lagSteps = 1;
+	options.precision = LaplacianSmoother::Precision::Double;
+	return options;
+}
+LaplacianSmoother smoother(SmootherOptions()); // keeps the symbolic factorization between iterations
+TaubinSmoother taubin;      // explicit alternative, no solve
+RegionSmoother boundaryBand;  // implicit steps on the open boundary only, e.g. the jaw and hair cut
+SpectralSmoother spectral;  // filter in a Laplacian eigenbasis, any amount at O(n*k)
 
 bool g_hasTexture = false;
 string g_texturePath = "";
 bool g_isTextured = true;
 bool g_isLeftButtonPressed = false;
+bool g_isExplicitSmoothing = false;
+const int   g_taubinIterations = 10;
+double g_spectralAmount = 0.0;
+const int   g_boundaryBandRings = 4;
+const double g_weldEpsilon = 2.2204e-15;  // vertices of an obj closer than this are merged
+const double g_volumeIso = 1.0;           // same iso value as im2obj.py
 const int   g_windowMultiplier = 2;
 const int   g_windowWidth  = 192*2 * g_windowMultiplier;
 const int   g_windowHeight = 192   * g_windowMultiplier;
@@ -52,6 +85,7 @@ glm::fvec3 g_lightDirection = { 1,1,1 };
 std::unique_ptr<FaceModel> g_pFaceModel;
 std::unique_ptr<ShaderProgram> g_pShaderProgram;
 std::unique_ptr<DirectionalLightSphere> g_pDLSphere;
+std::unique_ptr<SmoothingWorker> g_pSmoothingWorker;
 
 static void keyCallback(GLFWwindow* window, int key, int scancode, int action, int mode)
 {
@@ -63,9 +97,16 @@ static void keyCallback(GLFWwindow* window, int key, int scancode, int action, i
 
 	if (key == GLFW_KEY_SPACE && action == GLFW_PRESS)
 	{
-		Utilities::Laplacian::Smooth(U, F, L);
-		igl::per_vertex_normals(U, F, N);
-		g_pFaceModel->LoadMesh(U, N, F);
+		// presses queued while the worker is busy run as one batch
+		if (g_isExplicitSmoothing)
+			g_pSmoothingWorker->Post({ SmoothingWorker::RequestType::Explicit, g_taubinIterations, 0.0 });
+		else
+			g_pSmoothingWorker->Post({ SmoothingWorker::RequestType::Implicit, 1, 0.0 });
+	}
+
+	if (key == GLFW_KEY_B && action == GLFW_PRESS)
+	{
+		g_pSmoothingWorker->Post({ SmoothingWorker::RequestType::Region, 1, 0.0 });
 	}
 
 	if (key == GLFW_KEY_T && action == GLFW_PRESS)
@@ -73,11 +114,33 @@ static void keyCallback(GLFWwindow* window, int key, int scancode, int action, i
 		g_isTextured = !g_isTextured;
 	}
 
+	if (key == GLFW_KEY_E && action == GLFW_PRESS)
+	{
+		g_isExplicitSmoothing = !g_isExplicitSmoothing;
+		std::cout << (g_isExplicitSmoothing ? "Explicit Taubin smoothing" : "Implicit smoothing") << std::endl;
+	}
+
 	if (key == GLFW_KEY_R && action == GLFW_PRESS)
 	{
-		U = V;
-		igl::per_vertex_normals(V, F, N);
-		g_pFaceModel->LoadMesh(V, N, F);
+		g_pSmoothingWorker->Cancel();
+		g_pSmoothingWorker->Post({ SmoothingWorker::RequestType::Reset, 0, 0.0 });
+	}
+
+	if ((key == GLFW_KEY_EQUAL || key == GLFW_KEY_KP_ADD || key == GLFW_KEY_MINUS || key == GLFW_KEY_KP_SUBTRACT)
+		&& (action == GLFW_PRESS || action == GLFW_REPEAT))
+	{
+		// the amount applies to the original vertices, whatever was smoothed before is
+		// discarded; the first press computes the eigenbasis, which takes a while and
+		// is abandoned by C or R
+		const bool more = key == GLFW_KEY_EQUAL || key == GLFW_KEY_KP_ADD;
+		g_spectralAmount = std::max(0.0, g_spectralAmount + (more ? 0.25 : -0.25));
+		std::cout << "Spectral smoothing amount " << g_spectralAmount << std::endl;
+		g_pSmoothingWorker->Post({ SmoothingWorker::RequestType::Spectral, 0, g_spectralAmount });
+	}
+
+	if (key == GLFW_KEY_C && action == GLFW_PRESS)
+	{
+		g_pSmoothingWorker->Cancel();
 	}
 
 	if (key == GLFW_KEY_GRAVE_ACCENT && action == GLFW_PRESS)
@@ -140,7 +203,7 @@ int main(int argc, char *argv[])
 {
 	if (argc != 2 && argc != 3) {
 		cout << "Usage:\n\n"
-			"    renderer_bin <face_obj> [<diffuse>]\n" << endl;
+			"    renderer_bin <face_obj | face_volume.npy | face_volume.raw> [<diffuse>]\n" << endl;
 		return -1;
 	}
 	if (argc == 3) {
@@ -187,36 +250,103 @@ int main(int argc, char *argv[])
 	g_pShaderProgram->Use();
 	g_pShaderProgram->SetDefaults();
 
-	std::cout << "Loading Obj File..." << std::endl;
-	igl::readOBJ(argv[1], rawV, rawF);
+	// the cleaned mesh and L are cached next to the obj or volume, keyed by its contents
+	// and the parameters it is cleaned or extracted with
+	const string cachePath = string(argv[1]) + ".cache";
+	const bool isVolume = Volume::IsVolumePath(argv[1]);
+	MeshCache::Key cacheKey = { 0, isVolume ? 0.0 : g_weldEpsilon, isVolume ? g_volumeIso : 0.0 };
+	MeshCache cache;
+	const bool isCached = MeshCache::HashFile(argv[1], cacheKey.sourceHash) && cache.Open(cachePath, cacheKey);
+	const bool isLaplacianCached = isCached && cache.HasLaplacian();
+	const bool isCacheComplete = isLaplacianCached && cache.HasNormals();
 
-	std::cout << "Cleaning Mesh..." << std::endl;
 	VectorXi I;
-	Utilities::Clean::RemoveDuplicates(rawV, rawF, V, F, I);
+	if (isCached)
+	{
+		std::cout << "Loading Mesh Cache..." << std::endl;
+		V = cache.GetVertices();
+		F = cache.GetFaces();
+		I = cache.GetRemap();
+		// normals of V, all the un-smoothed mesh needs
+		if (cache.HasNormals()) N = cache.GetNormals().cast<double>();
+		if (isLaplacianCached) cache.GetLaplacian(L);
+		cache.Close();
+	}
+	else if (isVolume)
+	{
+		std::cout << "Extracting Surface from Volume..." << std::endl;
+		Volume volume;
+		if (!volume.Open(argv[1]))
+		{
+			cerr << "Failed to load volume: " << volume.GetError() << endl;
+			glfwTerminate();
+			return -1;
+		}
+		// same axes as im2obj.py, the vertices are shared already
+		volume.ExtractSurface(g_volumeIso, V, F);
+		I = VectorXi::LinSpaced(V.rows(), 0, V.rows() - 1);
+	}
+	else
+	{
+		std::cout << "Loading Obj File..." << std::endl;
+		ObjReader objReader;
+		if (!objReader.Read(argv[1], rawV, rawF))
+		{
+			cerr << "Failed to load mesh: " << objReader.GetError() << endl;
+			glfwTerminate();
+			return -1;
+		}
+
+		std::cout << "Cleaning Mesh..." << std::endl;
+		Utilities::Clean::RemoveDuplicates(rawV, rawF, V, F, I, g_weldEpsilon);
+	}
 
 	std::cout << "Copying Vertices..." << std::endl;
 	// copy vertices for updating
 	U = V;
 
-	std::cout << "Precomputing Laplace-Beltrami Operator..." << std::endl;
-	Utilities::Laplacian::Precompute(V, F, L, &K);
-
-#ifdef NDEBUG
-	for (int i = 0; i < 2; i++)
+	if (!isLaplacianCached)
+	{
+		std::cout << "Precomputing Laplace-Beltrami Operator..." << std::endl;
+		Utilities::Laplacian::Precompute(V, F, L, &K);
+	}
+	if (!isCacheComplete)
 	{
-		std::cout << "Smoothing, iteration " << i << "..." << std::endl;
-		Utilities::Laplacian::Smooth(U, F, L);
+		std::cout << "Writing Mesh Cache..." << std::endl;
+		igl::per_vertex_normals(V, F, N);
+		if (!MeshCache::Write(cachePath, cacheKey, V, F, I, &N, &L))
+			cerr << "Failed to write " << cachePath << endl;
 	}
+	smoother.Analyze(F, L);
+	taubin.Analyze(V, F);
+
+	std::vector<int> border;
+	const std::vector<bool> isBorder = igl::is_border_vertex(V, F);
+	for (int i = 0; i < int(isBorder.size()); i++)
+		if (isBorder[i]) border.push_back(i);
+	boundaryBand.Analyze(V, F, L, RegionSmoother::GrowRegion(L, border, g_boundaryBandRings));
+
+#ifdef NDEBUG
+	std::cout << "Smoothing, 2 iterations..." << std::endl;
+	smoother.Smooth(U, 2);
 
 	std::cout << "Computing Normals of Smoothed Mesh..." << std::endl;
+	igl::per_vertex_normals(U, F, N);
 #else
-	std::cout << "Computing Normals of un-smoothed Mesh..." << std::endl;
+	// U is still V, its normals were cached or computed for the cache
+	if (N.rows() != U.rows())
+	{
+		std::cout << "Computing Normals of un-smoothed Mesh..." << std::endl;
+		igl::per_vertex_normals(U, F, N);
+	}
 #endif
-	igl::per_vertex_normals(U, F, N);
 
 	std::cout << "Building Face Model..." << std::endl;
 	g_pFaceModel = std::make_unique<FaceModel>(U, N, F, g_texturePath);
 
+	// from here on the smoothers belong to the worker
+	g_pSmoothingWorker = std::make_unique<SmoothingWorker>(smoother, taubin, boundaryBand, spectral, V, U, F, L);
+
 	const auto faceView = glm::lookAt(glm::fvec3{ 96, 96, 400 }, { 96,96,0 }, { 0, -1, 0 });
 	const auto facePerspective = glm::perspective<float>(glm::pi<float>() / 6.0f, 1.0f, 0.01f, 1000.0f);
 	//const auto facePerspective = glm::ortho<float>(-96, 96, -96, 96, 0.01, 1000);
@@ -230,6 +360,8 @@ int main(int argc, char *argv[])
 	while (!glfwWindowShouldClose(g_pWindow))
 	{
 		glfwPollEvents();
+		if (g_pSmoothingWorker->Fetch(g_displayU, g_displayN))
+			g_pFaceModel->LoadMesh(g_displayU, g_displayN, F);
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 		glEnable(GL_DEPTH_TEST);
 
@@ -252,6 +384,7 @@ int main(int argc, char *argv[])
 		glfwSwapBuffers(g_pWindow);
 	}
 
+	g_pSmoothingWorker.reset();
 	glfwTerminate();
 
 	return 0;
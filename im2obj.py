@@ -20,7 +20,7 @@ import torch as th
 
 from PIL import Image
 from vrn_pytorch.vrn_unguided import vrn_unguided
-from utils import chw2hwc, hwc2chw, write_mask
+from utils import chw2hwc, hwc2chw, write_mask, file_hash, weld_vertices, write_mesh_cache
 
 xsize = 192
 ysize = 192
@@ -32,6 +32,7 @@ im = np.asarray(Image.open(args.i).resize((xsize,ysize)), dtype=np.float32)[:,:,
 print("Computing face volume...")
 vols = vrn_unguided(th.autograd.Variable(th.Tensor(np.array([hwc2chw(im)]))))
 vol = (vols[0][0].data.numpy() * 255).astype(np.uint8)
+np.save(basename + ".npy", vol)  # the renderer can extract the surface itself
 
 mask = (np.sum(vol, axis=0) > 1) * 255.0
 
@@ -45,6 +46,10 @@ vertices = vertices[:,(2,1,0)]
 vertices[:,2] *= 0.5 # scale the Z component correctly
 mcubes.export_obj(vertices, triangles, args.o)
 
+# hand the cleaned mesh to the renderer directly, it skips parsing and welding
+vertices, faces, remap = weld_vertices(vertices, triangles)
+write_mesh_cache(args.o + ".cache", file_hash(args.o), vertices, faces, remap)
+
 # print("""Done.
 #   mesh saved as {}
 #   mask saved as {}""".format(args.o, mask_name))
@@ -1,3 +1,5 @@
+import struct
+
 import png
 import numpy as np
 
@@ -17,3 +19,58 @@ def write_mask(name, width, height, data):
     w = png.Writer(width, height, greyscale=True, bitdepth=8)
     w.write(f, data)
     f.close()
+
+def _splitmix64(x):
+    """splitmix64 finalizer of a uint64 array, wrapping like the C++ version"""
+    x = x + np.uint64(0x9E3779B97F4A7C15)
+    x = (x ^ (x >> np.uint64(30))) * np.uint64(0xBF58476D1CE4E5B9)
+    x = (x ^ (x >> np.uint64(27))) * np.uint64(0x94D049BB133111EB)
+    return x ^ (x >> np.uint64(31))
+
+def file_hash(name):
+    """Content hash of a file, the key of the renderer's mesh cache (MeshCache::Hash)"""
+    data = np.fromfile(name, dtype=np.uint8)
+    size = data.size
+    data = np.concatenate([data, np.zeros(-size % 8, dtype=np.uint8)])
+    words = data.view("<u8").astype(np.uint64)
+    with np.errstate(over="ignore"):
+        index = np.arange(words.size, dtype=np.uint64) * np.uint64(0xD6E8FEB86659FD93)
+        total = np.sum(_splitmix64(words + index), dtype=np.uint64)
+        return int(_splitmix64(np.array([total ^ np.uint64(size)], dtype=np.uint64))[0])
+
+def weld_vertices(vertices, triangles):
+    """Merge exactly coincident vertices and drop the triangles that collapse,
+    returns the welded vertices, triangles and the old to new vertex remap"""
+    welded, remap = np.unique(vertices, axis=0, return_inverse=True)
+    remap = remap.reshape(-1)
+    faces = remap[triangles]
+    keep = (faces[:,0] != faces[:,1]) & (faces[:,1] != faces[:,2]) & (faces[:,0] != faces[:,2])
+    return welded, faces[keep], remap
+
+# the renderer's weld epsilon of obj files (g_weldEpsilon in main.cpp), part of the
+# cache key; the vertices PyMCubes makes from a uint8 volume are either equal or at
+# least 1/255 of a voxel apart, so weld_vertices merges the same ones
+WELD_EPSILON = 2.2204e-15
+
+def write_mesh_cache(name, source_hash, vertices, faces, remap):
+    """Write a cleaned mesh in the renderer's cache format (MeshCache.h), without
+    normals and Laplacian, the renderer adds them on first load"""
+    sections = [
+        np.asfortranarray(vertices, dtype="<f8"),  # column major like Eigen::MatrixXd
+        np.ascontiguousarray(faces, dtype="<i4"),
+        np.ascontiguousarray(remap, dtype="<i4"),
+    ]
+    offsets = []
+    offset = 128
+    for section in sections:
+        offset = (offset + 63) // 64 * 64
+        offsets.append(offset)
+        offset += section.nbytes
+    header = struct.pack("<8sIIQqqqq7Qdd", b"VRNMESH\0", 2, 0, source_hash,
+        vertices.shape[0], faces.shape[0], remap.shape[0], 0, *(offsets + [0] * 4),
+        WELD_EPSILON, 0.0)
+    with open(name, "wb") as f:
+        f.write(header)
+        for offset, section in zip(offsets, sections):
+            f.write(b"\0" * (offset - f.tell()))
+            f.write(section.tobytes(order="A"))